@@ -0,0 +1,328 @@
+// Concurrent range fetches over HTTP/1.1 and over HTTP/2 (h2c).
+//
+// Each round asks for `streams` random ranges of one file at once, the way a
+// player fills its buffer from several segments: over HTTP/1.1 on as many
+// keep-alive connections, over HTTP/2 as that many streams of a single
+// connection. Prints the connections used and the latency of each request,
+// from the start of its round to its last byte. The server must run with
+// --h2c.
+//
+//   h2_ranges HOST PORT PATH [streams=16] [range_kb=256] [rounds=50]
+
+#include <httplib.h>
+
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Range {
+    size_t first;
+    size_t last;
+
+    std::string header() const {
+        return "bytes=" + std::to_string(first) + "-" + std::to_string(last);
+    }
+    size_t size() const { return last - first + 1; }
+};
+
+static std::vector<std::vector<Range>> make_rounds(size_t file_size, int rounds,
+                                                   int streams, size_t range_size) {
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<size_t> pick(0, (file_size - range_size) / 4096);
+    std::vector<std::vector<Range>> out(rounds);
+    for (auto& round : out) {
+        for (int i = 0; i < streams; i++) {
+            size_t first = pick(rng) * 4096;
+            round.push_back({first, first + range_size - 1});
+        }
+    }
+    return out;
+}
+
+static double ms_since(Clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+static bool run_http1(const std::string& host, int port, const std::string& path,
+                      const std::vector<std::vector<Range>>& rounds,
+                      std::vector<double>& ms) {
+    size_t streams = rounds[0].size();
+    std::vector<std::unique_ptr<httplib::Client>> clients;
+    for (size_t i = 0; i < streams; i++) {
+        clients.push_back(std::make_unique<httplib::Client>(host, port));
+        clients.back()->set_keep_alive(true);
+    }
+    bool ok = true;
+    for (const auto& round : rounds) {
+        std::vector<double> round_ms(streams);
+        std::vector<std::thread> threads;
+        auto start = Clock::now();
+        for (size_t i = 0; i < streams; i++) {
+            threads.emplace_back([&, i] {
+                auto res = clients[i]->Get(path, {{"Range", round[i].header()}});
+                round_ms[i] = ms_since(start);
+                if (!res || res->status != 206 || res->body.size() != round[i].size()) {
+                    ok = false;
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        ms.insert(ms.end(), round_ms.begin(), round_ms.end());
+    }
+    return ok;
+}
+
+// Just enough of an HTTP/2 client for GETs: the server's HPACK, a window
+// large enough that the server never waits on ours, and frames read whole.
+class H2Client {
+public:
+    H2Client() : decoder_(CPPHTTPLIB_REQUEST_HEAD_MAX_LENGTH) {}
+    ~H2Client() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    bool connect(const std::string& host, int port) {
+        addrinfo hints{};
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* ai = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &ai) != 0) {
+            return false;
+        }
+        fd_ = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        bool ok = fd_ >= 0 && ::connect(fd_, ai->ai_addr, ai->ai_addrlen) == 0;
+        freeaddrinfo(ai);
+        if (!ok) return false;
+        int one = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::string out(httplib::detail::http2::connection_preface,
+                        httplib::detail::http2::connection_preface_size);
+        // SETTINGS_INITIAL_WINDOW_SIZE, then the connection window to match.
+        char settings[6] = {0, 0x4};
+        put_u32(settings + 2, kWindow);
+        frame(out, 0x4, 0, 0, settings, sizeof(settings));
+        char increment[4];
+        put_u32(increment, kWindow - 65535);
+        frame(out, 0x8, 0, 0, increment, sizeof(increment));
+        return send_all(out);
+    }
+
+    // Sends one GET per range and waits for all of them, recording when
+    // each finished.
+    bool fetch(const std::string& authority, const std::string& path,
+               const std::vector<Range>& ranges, std::vector<double>& ms) {
+        auto start = Clock::now();
+        std::string out;
+        std::map<uint32_t, size_t> pending;
+        for (size_t i = 0; i < ranges.size(); i++) {
+            std::string block;
+            encoder_.encode(":method", "GET", block);
+            encoder_.encode(":scheme", "http", block);
+            encoder_.encode(":authority", authority, block);
+            encoder_.encode(":path", path, block);
+            encoder_.encode("range", ranges[i].header(), block);
+            frame(out, 0x1, 0x5, next_id_, block.data(), block.size());
+            pending[next_id_] = i;
+            received_[next_id_] = 0;
+            next_id_ += 2;
+        }
+        if (!send_all(out)) return false;
+
+        std::vector<double> round_ms(ranges.size());
+        while (!pending.empty()) {
+            uint8_t type, flags;
+            uint32_t id;
+            std::string payload;
+            if (!read_frame(type, flags, id, payload)) return false;
+            out.clear();
+            switch (type) {
+            case 0x0: // DATA
+                received_[id] += payload.size();
+                if (!payload.empty()) {
+                    char inc[4];
+                    put_u32(inc, static_cast<uint32_t>(payload.size()));
+                    frame(out, 0x8, 0, 0, inc, sizeof(inc));
+                }
+                break;
+            case 0x1:   // HEADERS
+            case 0x9: { // CONTINUATION
+                block_ += payload;
+                if (!(flags & 0x4)) break;
+                httplib::detail::http2::HeaderFields fields;
+                if (!decoder_.decode(reinterpret_cast<const uint8_t*>(block_.data()),
+                                     block_.size(), fields) ||
+                    fields.empty() || fields[0].second != "206") {
+                    return false;
+                }
+                block_.clear();
+                break;
+            }
+            case 0x3: // RST_STREAM
+            case 0x7: // GOAWAY
+                return false;
+            case 0x4: // SETTINGS
+                if (!(flags & 0x1)) frame(out, 0x4, 0x1, 0, nullptr, 0);
+                break;
+            case 0x6: // PING
+                if (!(flags & 0x1)) frame(out, 0x6, 0x1, 0, payload.data(), payload.size());
+                break;
+            }
+            if (!out.empty() && !send_all(out)) return false;
+
+            if ((type == 0x0 || type == 0x1) && (flags & 0x1)) {
+                auto it = pending.find(id);
+                if (it == pending.end() || received_[id] != ranges[it->second].size()) {
+                    return false;
+                }
+                round_ms[it->second] = ms_since(start);
+                pending.erase(it);
+                received_.erase(id);
+            }
+        }
+        ms.insert(ms.end(), round_ms.begin(), round_ms.end());
+        return true;
+    }
+
+private:
+    static constexpr uint32_t kWindow = 1 << 30;
+
+    static void put_u32(char* p, uint32_t v) {
+        p[0] = static_cast<char>(v >> 24);
+        p[1] = static_cast<char>(v >> 16);
+        p[2] = static_cast<char>(v >> 8);
+        p[3] = static_cast<char>(v);
+    }
+
+    static void frame(std::string& out, uint8_t type, uint8_t flags, uint32_t id,
+                      const char* payload, size_t len) {
+        char head[9] = {static_cast<char>(len >> 16), static_cast<char>(len >> 8),
+                        static_cast<char>(len), static_cast<char>(type),
+                        static_cast<char>(flags)};
+        put_u32(head + 5, id);
+        out.append(head, sizeof(head));
+        if (len > 0) out.append(payload, len);
+    }
+
+    bool send_all(const std::string& data) {
+        for (size_t off = 0; off < data.size();) {
+            ssize_t n = send(fd_, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            off += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool read_frame(uint8_t& type, uint8_t& flags, uint32_t& id, std::string& payload) {
+        while (in_.size() - in_off_ < 9 || in_.size() - in_off_ < 9 + frame_length()) {
+            if (in_off_ > 0) {
+                in_.erase(0, in_off_);
+                in_off_ = 0;
+            }
+            char buf[65536];
+            ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+            if (n <= 0) return false;
+            in_.append(buf, static_cast<size_t>(n));
+        }
+        auto p = reinterpret_cast<const uint8_t*>(in_.data()) + in_off_;
+        size_t len = frame_length();
+        type = p[3];
+        flags = p[4];
+        id = (static_cast<uint32_t>(p[5]) << 24 | p[6] << 16 | p[7] << 8 | p[8]) & 0x7fffffff;
+        payload.assign(in_, in_off_ + 9, len);
+        in_off_ += 9 + len;
+        return true;
+    }
+
+    size_t frame_length() const {
+        auto p = reinterpret_cast<const uint8_t*>(in_.data()) + in_off_;
+        return static_cast<size_t>(p[0]) << 16 | p[1] << 8 | p[2];
+    }
+
+    int fd_ = -1;
+    uint32_t next_id_ = 1;
+    std::string in_;
+    size_t in_off_ = 0;
+    std::string block_;
+    std::map<uint32_t, size_t> received_;
+    httplib::detail::http2::HpackEncoder encoder_;
+    httplib::detail::http2::HpackDecoder decoder_;
+};
+
+static void report(const char* name, size_t connections, std::vector<double> ms,
+                   size_t bytes, double seconds) {
+    std::sort(ms.begin(), ms.end());
+    double mean = 0;
+    for (double v : ms) mean += v;
+    mean /= ms.size();
+    auto pct = [&](double p) { return ms[std::min(ms.size() - 1, size_t(p * ms.size()))]; };
+    printf("%-8s connections=%zu requests=%zu MBps=%.1f latency_ms mean=%.2f p50=%.2f "
+           "p99=%.2f max=%.2f\n",
+           name, connections, ms.size(), bytes / seconds / 1e6, mean, pct(0.50), pct(0.99),
+           ms.back());
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s HOST PORT PATH [streams] [range_kb] [rounds]\n", argv[0]);
+        return 1;
+    }
+    std::string host = argv[1];
+    int port = std::atoi(argv[2]);
+    std::string path = argv[3];
+    int streams = argc > 4 ? std::atoi(argv[4]) : 16;
+    size_t range_size = (argc > 5 ? std::atol(argv[5]) : 256) * 1024;
+    int rounds = argc > 6 ? std::atoi(argv[6]) : 50;
+
+    httplib::Client probe(host, port);
+    auto head = probe.Head(path);
+    if (!head || head->status != 200) {
+        fprintf(stderr, "HEAD %s failed\n", path.c_str());
+        return 1;
+    }
+    size_t file_size = std::stoull(head->get_header_value("Content-Length"));
+    if (file_size < range_size) {
+        fprintf(stderr, "%s is smaller than one range\n", path.c_str());
+        return 1;
+    }
+    auto plan = make_rounds(file_size, rounds, streams, range_size);
+    size_t bytes = static_cast<size_t>(rounds) * streams * range_size;
+    printf("file_bytes=%zu streams=%d range_bytes=%zu rounds=%d\n", file_size, streams,
+           range_size, rounds);
+
+    std::vector<double> ms;
+    auto start = Clock::now();
+    if (!run_http1(host, port, path, plan, ms)) {
+        fprintf(stderr, "HTTP/1.1 fetch failed\n");
+        return 1;
+    }
+    report("http/1.1", streams, ms, bytes, ms_since(start) / 1000);
+
+    ms.clear();
+    H2Client h2;
+    start = Clock::now();
+    if (!h2.connect(host, port)) {
+        fprintf(stderr, "cannot connect\n");
+        return 1;
+    }
+    for (const auto& round : plan) {
+        if (!h2.fetch(host + ":" + std::to_string(port), path, round, ms)) {
+            fprintf(stderr, "HTTP/2 fetch failed; is the server running with --h2c?\n");
+            return 1;
+        }
+    }
+    report("h2c", 1, ms, bytes, ms_since(start) / 1000);
+    return 0;
+}
@@ -0,0 +1,71 @@
+// Cost of the HTTP date text a response carries.
+//
+// Times three ways of producing it: gmtime_r() and strftime() per call, as
+// Last-Modified used to be formatted; httplib's formatter, which does the
+// calendar arithmetic itself; and a read of the DateClock string the Date
+// header copies, refreshed once a second by its own thread. First checks
+// that the formatter writes what strftime() does across four centuries.
+//
+//   http_date [iterations=2000000]
+
+#include <httplib.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+
+using Clock = std::chrono::steady_clock;
+
+static std::string strftime_date(time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    size_t n = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buf, n);
+}
+
+template <typename Fn>
+static void time_it(const char* name, long iterations, Fn fn) {
+    size_t sink = 0;
+    auto start = Clock::now();
+    for (long i = 0; i < iterations; i++) sink += fn(i);
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    // Keeps the loop from being optimised away.
+    if (sink == 0) printf("?");
+    printf("%-10s %7.1f ns/date\n", name, ns / iterations);
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = argc > 1 ? std::atol(argv[1]) : 2000000;
+
+    // 1900 to 2299, stepping an odd number of seconds so every field moves.
+    for (time_t t = -2208988800; t < 10413792000; t += 86400 * 7 + 3607) {
+        if (httplib::detail::format_http_date(t) != strftime_date(t)) {
+            fprintf(stderr, "mismatch at %lld: %s vs %s\n", static_cast<long long>(t),
+                    httplib::detail::format_http_date(t).c_str(), strftime_date(t).c_str());
+            return 1;
+        }
+    }
+
+    time_t now = time(nullptr);
+    char buf[httplib::detail::http_date_length];
+    time_it("strftime", iterations, [&](long i) {
+        struct tm tm;
+        time_t t = now + (i & 1);
+        gmtime_r(&t, &tm);
+        char text[64];
+        return strftime(text, sizeof(text), "%a, %d %b %Y %H:%M:%S GMT", &tm) + text[5];
+    });
+    time_it("formatter", iterations, [&](long i) {
+        httplib::detail::format_http_date(now + (i & 1), buf);
+        return static_cast<size_t>(buf[5]);
+    });
+    const auto& clock = httplib::detail::date_clock();
+    time_it("cached", iterations, [&](long) {
+        clock.read(buf);
+        return static_cast<size_t>(buf[5]);
+    });
+    return 0;
+}
@@ -0,0 +1,191 @@
+// Request head parsing throughput.
+//
+// Rebuilds the request heads recorded in a service log and times parsing
+// them with the line reader the server used before and with
+// detail::parse_request_head under each scanner the CPU supports, and counts
+// heap allocations per head.
+//
+//   parse_headers LOG [iterations=200000]
+
+#include <httplib.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace httplib;
+using Clock = std::chrono::steady_clock;
+
+static size_t allocations = 0;
+
+// GCC cannot tell that these replace the global operators.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t n) {
+    allocations++;
+    if (void* p = std::malloc(n)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// Fields the server adds to the logged headers itself.
+static bool injected(const std::string& key) {
+    return key == "REMOTE_ADDR" || key == "REMOTE_PORT" ||
+           key == "LOCAL_ADDR" || key == "LOCAL_PORT";
+}
+
+static std::vector<std::string> load_heads(const char* path) {
+    std::ifstream in(path);
+    std::vector<std::string> heads;
+    std::string line, method, target, fields;
+    bool in_request = false, in_headers = false;
+    while (std::getline(in, line)) {
+        if (line.find("REQUEST") != std::string::npos) {
+            in_request = true;
+        } else if (line.find("RESPONSE") != std::string::npos) {
+            in_request = false;
+        } else if (!in_request) {
+            continue;
+        } else if (line.rfind("Method: ", 0) == 0) {
+            method = line.substr(8);
+        } else if (line.rfind("Path: ", 0) == 0) {
+            target = line.substr(6);
+        } else if (line == "Headers:") {
+            in_headers = true;
+            fields.clear();
+        } else if (in_headers && line.rfind("  ", 0) == 0) {
+            auto colon = line.find(": ");
+            if (colon == std::string::npos) continue;
+            auto key = line.substr(2, colon - 2);
+            if (!injected(key)) fields += key + ": " + line.substr(colon + 2) + "\r\n";
+        } else if (in_headers) {
+            heads.push_back(method + " " + target + " HTTP/1.1\r\n" + fields + "\r\n");
+            in_request = in_headers = false;
+        }
+    }
+    return heads;
+}
+
+struct Sample {
+    double ns;
+    double allocs;
+};
+
+template <typename F>
+static Sample run(const std::vector<std::string>& heads, int iterations, F parse) {
+    size_t ok = 0;
+    size_t allocs_before = allocations;
+    auto t0 = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        for (const auto& head : heads) ok += parse(head);
+    }
+    auto t1 = Clock::now();
+    if (ok != heads.size() * iterations) {
+        fprintf(stderr, "parse failed\n");
+        exit(1);
+    }
+    double n = static_cast<double>(iterations) * heads.size();
+    return {std::chrono::duration<double, std::nano>(t1 - t0).count() / n,
+            (allocations - allocs_before) / n};
+}
+
+// The server's previous path: request line and headers read a line at a time
+// through the stream, each field copied into Headers.
+static bool parse_lines(const std::string& head) {
+    detail::BufferStream strm;
+    strm.write(head.data(), head.size());
+    char buf[CPPHTTPLIB_REQUEST_URI_MAX_LENGTH];
+    detail::stream_line_reader line_reader(strm, buf, sizeof(buf));
+    if (!line_reader.getline()) return false;
+    std::string method, target, version;
+    int i = 0;
+    detail::split(line_reader.ptr(), line_reader.ptr() + line_reader.size() - 2, ' ',
+                  [&](const char* b, const char* e) {
+                      (i == 0 ? method : i == 1 ? target : version).assign(b, e);
+                      i++;
+                  });
+    Headers headers;
+    return i == 3 && detail::read_headers(strm, headers);
+}
+
+// The new path, parse only: views into the head buffer.
+static bool parse_views(const std::string& head, detail::scan_head_fn scan) {
+    detail::RequestHead parsed;
+    return detail::parse_request_head(head.data(), head.data() + head.size(),
+                                      parsed, scan);
+}
+
+// The new path as the server runs it: views copied into Headers.
+static bool parse_into_headers(const std::string& head, detail::scan_head_fn scan) {
+    detail::RequestHead parsed;
+    if (!detail::parse_request_head(head.data(), head.data() + head.size(),
+                                    parsed, scan)) {
+        return false;
+    }
+    std::string method(parsed.method.data, parsed.method.size);
+    std::string target(parsed.target.data, parsed.target.size);
+    std::string version(parsed.version.data, parsed.version.size);
+    Headers headers;
+    for (size_t i = 0; i < parsed.field_count; i++) {
+        const auto& f = parsed.fields[i];
+        headers.emplace(std::string(f.first.data, f.first.size),
+                        std::string(f.second.data, f.second.size));
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s LOG [iterations]\n", argv[0]);
+        return 1;
+    }
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 200000;
+    auto heads = load_heads(argv[1]);
+    if (heads.empty()) {
+        fprintf(stderr, "no requests in %s\n", argv[1]);
+        return 1;
+    }
+    size_t bytes = 0;
+    for (const auto& h : heads) bytes += h.size();
+    printf("heads=%zu avg_bytes=%zu iterations=%d\n", heads.size(),
+           bytes / heads.size(), iterations);
+
+    struct Scanner {
+        const char* name;
+        detail::scan_head_fn fn;
+    };
+    std::vector<Scanner> scanners = {{"scalar", &detail::scan_head_scalar}};
+#ifdef CPPHTTPLIB_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        scanners.push_back({"sse4.2", &detail::scan_head_sse42});
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        scanners.push_back({"avx2", &detail::scan_head_avx2});
+    }
+#endif
+
+    auto report = [&](const char* name, Sample r) {
+        printf("%-24s %8.1f ns/head %8.0f MB/s %6.1f allocs/head\n", name, r.ns,
+               bytes / static_cast<double>(heads.size()) / r.ns * 1e3, r.allocs);
+    };
+    report("line reader", run(heads, iterations / 10, parse_lines));
+    for (const auto& s : scanners) {
+        std::string name = std::string(s.name) + " + Headers";
+        report(name.c_str(), run(heads, iterations, [&](const std::string& h) {
+                   return parse_into_headers(h, s.fn);
+               }));
+    }
+    for (const auto& s : scanners) {
+        std::string name = std::string(s.name) + " views only";
+        report(name.c_str(), run(heads, iterations, [&](const std::string& h) {
+                   return parse_views(h, s.fn);
+               }));
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+// HTTP/1.1 pipelining: throughput of small requests sent `depth` at a time.
+//
+// Writes each batch of `depth` GETs in one send on a keep-alive connection
+// and reads until every response has arrived, checking that each is a 200
+// with the body its Content-Length announces. Depth 1 is the
+// request-response loop of a client that does not pipeline. Also counts the
+// reads a batch took: responses the server sent together arrive together.
+// When the server closes the connection at its keep-alive limit, the
+// unanswered rest of the batch is sent again on a new one.
+//
+//   pipelining HOST PORT PATH [requests=20000] [depths=1,4,16,64]
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static int connect_to(const std::string& host, int port) {
+    addrinfo hints{};
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* ai = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &ai) != 0) return -1;
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(ai);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // A server that loses pipelined requests never answers them.
+    timeval tv{2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+// Consumes complete responses from the front of `in`; false on a malformed
+// or non-200 one.
+static bool take_responses(std::string& in, size_t& responses) {
+    for (;;) {
+        size_t end = in.find("\r\n\r\n");
+        if (end == std::string::npos) return true;
+        if (in.compare(0, 12, "HTTP/1.1 200") != 0) return false;
+        size_t length = 0;
+        size_t pos = in.find("Content-Length: ");
+        if (pos != std::string::npos && pos < end) length = std::strtoul(&in[pos + 16], nullptr, 10);
+        if (in.size() < end + 4 + length) return true;
+        in.erase(0, end + 4 + length);
+        responses++;
+    }
+}
+
+static bool run(const std::string& host, int port, const std::string& path, int requests,
+                int depth) {
+    int fd = connect_to(host, port);
+    if (fd < 0) {
+        fprintf(stderr, "cannot connect\n");
+        return false;
+    }
+    std::string one = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\n\r\n";
+    std::string batch;
+    for (int i = 0; i < depth; i++) batch += one;
+
+    std::string in;
+    char buf[65536];
+    size_t reads = 0;
+    size_t connections = 1;
+    size_t served = 0; // on this connection
+    int batches = requests / depth;
+    auto start = Clock::now();
+    for (int b = 0; b < batches; b++) {
+        if (send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(batch.size())) {
+            fprintf(stderr, "send failed\n");
+            close(fd);
+            return false;
+        }
+        size_t responses = 0;
+        while (responses < static_cast<size_t>(depth)) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n == 0 && served > 0) {
+                close(fd);
+                fd = connect_to(host, port);
+                size_t rest = (depth - responses) * one.size();
+                if (fd < 0 || send(fd, batch.data(), rest, MSG_NOSIGNAL) != static_cast<ssize_t>(rest)) {
+                    fprintf(stderr, "reconnect failed\n");
+                    return false;
+                }
+                in.clear();
+                served = 0;
+                connections++;
+                continue;
+            }
+            if (n <= 0) {
+                fprintf(stderr, "depth %d: %zu of %d responses in batch %d\n", depth,
+                        responses, depth, b);
+                close(fd);
+                return false;
+            }
+            reads++;
+            in.append(buf, static_cast<size_t>(n));
+            size_t before = responses;
+            if (!take_responses(in, responses)) {
+                fprintf(stderr, "depth %d: bad response\n", depth);
+                close(fd);
+                return false;
+            }
+            served += responses - before;
+        }
+    }
+    double sec = std::chrono::duration<double>(Clock::now() - start).count();
+    close(fd);
+
+    int done = batches * depth;
+    printf("depth=%-3d requests=%d connections=%zu req_per_s=%.0f us_per_req=%.2f "
+           "reads_per_batch=%.2f\n",
+           depth, done, connections, done / sec, sec * 1e6 / done,
+           static_cast<double>(reads) / batches);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s HOST PORT PATH [requests] [depths]\n", argv[0]);
+        return 1;
+    }
+    std::string host = argv[1];
+    int port = std::atoi(argv[2]);
+    std::string path = argv[3];
+    int requests = argc > 4 ? std::atoi(argv[4]) : 20000;
+    std::string depths = argc > 5 ? argv[5] : "1,4,16,64";
+
+    bool ok = true;
+    std::stringstream list(depths);
+    std::string depth;
+    while (std::getline(list, depth, ',')) {
+        ok = run(host, port, path, requests, std::max(1, std::atoi(depth.c_str()))) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+// Cost and accuracy of the popularity sketch.
+//
+// Draws requests for `keys` distinct paths from a Zipf distribution, the
+// usual shape of video popularity, and records them as the server does:
+// one DecayingSketch update and one TopK offer each. Prints the time per
+// request, then compares the TopK members with the exact top `k` counts:
+// how many of the true top k it holds, and how far its estimates are above
+// the true counts. No halving happens within the run.
+//
+//   popularity [requests=2000000] [keys=100000] [k=20] [zipf_s=1.0]
+
+#include "popularity.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char* argv[]) {
+    size_t requests = argc > 1 ? std::atol(argv[1]) : 2000000;
+    size_t keys = argc > 2 ? std::atol(argv[2]) : 100000;
+    size_t k = argc > 3 ? std::atol(argv[3]) : 20;
+    double s = argc > 4 ? std::atof(argv[4]) : 1.0;
+
+    std::vector<std::string> paths(keys);
+    for (size_t i = 0; i < keys; i++) paths[i] = "/videos/title" + std::to_string(i) + ".mp4";
+    std::vector<double> weights(keys);
+    for (size_t i = 0; i < keys; i++) weights[i] = 1.0 / std::pow(i + 1.0, s);
+    std::discrete_distribution<size_t> zipf(weights.begin(), weights.end());
+    std::mt19937_64 rng(42);
+    std::vector<uint32_t> trace(requests);
+    for (auto& r : trace) r = static_cast<uint32_t>(zipf(rng));
+    // Rank is not id: hot titles are spread over the key space.
+    std::shuffle(paths.begin(), paths.end(), std::mt19937_64(7));
+
+    DecayingSketch sketch(std::chrono::hours(1));
+    TopK top(64);
+    auto start = Clock::now();
+    for (uint32_t r : trace) {
+        const auto& path = paths[r];
+        auto h = std::hash<std::string>()(path);
+        top.offer(sketch, h, sketch.record(h), [&] { return path; });
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    printf("requests=%zu keys=%zu zipf_s=%.2f record_ns=%.1f top_evictions=%llu\n", requests,
+           keys, s, ns / requests, static_cast<unsigned long long>(top.evictions()));
+
+    std::unordered_map<uint32_t, uint64_t> exact;
+    for (uint32_t r : trace) exact[r]++;
+    std::vector<std::pair<uint64_t, uint32_t>> truth;
+    for (const auto& [id, count] : exact) truth.emplace_back(count, id);
+    std::sort(truth.rbegin(), truth.rend());
+    truth.resize(std::min(truth.size(), k));
+
+    std::map<std::string, size_t> members;
+    top.members(members);
+    size_t found = 0;
+    double worst = 0;
+    for (const auto& [count, id] : truth) {
+        auto it = members.find(paths[id]);
+        if (it == members.end()) continue;
+        found++;
+        worst = std::max(worst, (sketch.estimate(it->second) - double(count)) / count);
+    }
+    printf("top_%zu_recall=%zu/%zu max_overestimate=%.2f%%\n", k, found, truth.size(),
+           worst * 100);
+    return 0;
+}
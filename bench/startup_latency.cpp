@@ -0,0 +1,83 @@
+// Startup latency under concurrent bulk downloads.
+//
+// Keeps `bulk` connections pulling a large file end to end, then times
+// `samples` playback starts, one every 100ms: a fresh connection fetching the
+// first 64 KB of another file, as a player does before it can show the first
+// frame.
+//
+//   startup_latency HOST PORT BULK_PATH HEAD_PATH [bulk=4] [samples=50]
+
+#include <httplib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char* argv[]) {
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s HOST PORT BULK_PATH HEAD_PATH [bulk] [samples]\n",
+                argv[0]);
+        return 1;
+    }
+    std::string host = argv[1];
+    int port = std::atoi(argv[2]);
+    std::string bulk_path = argv[3];
+    std::string head_path = argv[4];
+    int bulk = argc > 5 ? std::atoi(argv[5]) : 4;
+    int samples = argc > 6 ? std::atoi(argv[6]) : 50;
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> bulk_bytes{0};
+    std::vector<std::thread> bulk_threads;
+    for (int i = 0; i < bulk; i++) {
+        bulk_threads.emplace_back([&] {
+            httplib::Client cli(host, port);
+            while (!stop) {
+                cli.Get(bulk_path, [&](const char*, size_t n) {
+                    bulk_bytes += n;
+                    return !stop;
+                });
+            }
+        });
+    }
+
+    // Let the bulk flows fill the bottleneck before measuring.
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+
+    auto started = Clock::now();
+    uint64_t bytes_before = bulk_bytes;
+    std::vector<double> ms;
+    for (int i = 0; i < samples; i++) {
+        auto t0 = Clock::now();
+        httplib::Client cli(host, port);
+        auto res = cli.Get(head_path, {{"Range", "bytes=0-65535"}});
+        auto t1 = Clock::now();
+        if (!res || res->status != 206 || res->body.size() != 65536) {
+            fprintf(stderr, "startup request %d failed\n", i);
+            continue;
+        }
+        ms.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+        std::this_thread::sleep_until(t0 + std::chrono::milliseconds(100));
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+    uint64_t bulk_during = bulk_bytes - bytes_before;
+
+    stop = true;
+    for (auto& t : bulk_threads) t.join();
+
+    if (ms.empty()) return 1;
+    std::sort(ms.begin(), ms.end());
+    auto pct = [&](double p) { return ms[std::min(ms.size() - 1, size_t(p * ms.size()))]; };
+    printf("startups=%zu bulk_clients=%d bulk_MBps=%.2f\n", ms.size(), bulk,
+           bulk_during / elapsed / 1e6);
+    printf("startup_ms p50=%.1f p90=%.1f p99=%.1f max=%.1f\n", pct(0.50),
+           pct(0.90), pct(0.99), ms.back());
+    return 0;
+}
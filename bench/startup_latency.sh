@@ -0,0 +1,32 @@
+#!/bin/sh
+# Compares playback startup latency behind a shaped loopback link with and
+# without the send scheduler. Needs root for tc and a built server.
+#
+#   bench/startup_latency.sh SERVER VIDEO_DIR BULK_FILE HEAD_FILE [link_mbit=80]
+set -e
+
+SERVER=$1
+DIR=$2
+BULK=$3
+HEAD=$4
+LINK=${5:-80}
+PORT=18080
+BENCH=$(dirname "$0")/startup_latency
+
+tc qdisc add dev lo root tbf rate ${LINK}mbit burst 64kb latency 50ms
+trap 'tc qdisc del dev lo root; kill $PID 2>/dev/null' EXIT
+
+run() {
+    "$SERVER" --path "$DIR" --port $PORT "$@" > /dev/null &
+    PID=$!
+    sleep 0.5
+    "$BENCH" 127.0.0.1 $PORT "/$BULK" "/$HEAD" 4 50
+    kill $PID
+    wait $PID 2>/dev/null || true
+}
+
+echo "== kernel queues only"
+run
+# Slightly under the link so the backlog stays in the scheduler.
+echo "== send scheduler at $((LINK * 95 / 100)) Mbit/s"
+run --egress-mbps $((LINK * 95 / 100))
@@ -0,0 +1,121 @@
+// TLB cost of buffer memory on 4 KB pages and on huge pages.
+//
+// Maps the same amount of memory both ways, as HugePagePool maps its
+// regions and as the allocator used to, links every 4 KB page into one
+// random cycle, and times following it: each step lands on a page the TLB
+// is unlikely to hold. dTLB load misses are counted with perf_event_open
+// where the kernel allows it (perf_event_paranoid <= 2 for user space).
+//
+//   tlb_buffers [megabytes=1024] [steps=20000000]
+
+#include "huge_pages.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static int open_dtlb_counter() {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+// Stores in each page a pointer to the next page of a random cycle, at a
+// different cache line in each so the chase is not also a cache set test.
+static char* link_pages(char* mem, size_t bytes) {
+    size_t pages = bytes / 4096;
+    std::vector<size_t> order(pages);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(42));
+    auto slot = [&](size_t page) { return mem + page * 4096 + (page % 64) * 64; };
+    for (size_t i = 0; i < pages; i++) {
+        *reinterpret_cast<char**>(slot(order[i])) = slot(order[(i + 1) % pages]);
+    }
+    return slot(order[0]);
+}
+
+static void chase(const char* name, char* mem, size_t bytes, long steps, int counter) {
+    char* p = link_pages(mem, bytes);
+    for (long i = 0; i < steps / 10; i++) p = *reinterpret_cast<char**>(p);
+
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    auto start = Clock::now();
+    for (long i = 0; i < steps; i++) p = *reinterpret_cast<char**>(p);
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    uint64_t misses = 0;
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &misses, sizeof(misses)) != sizeof(misses)) misses = 0;
+    }
+    // Keeps the chase from being optimised away.
+    if (p == nullptr) printf("?");
+
+    printf("%-12s %8.1f ns/step", name, ns / steps);
+    if (counter >= 0) {
+        printf("  %6.3f dTLB misses/step", static_cast<double>(misses) / steps);
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = argc > 1 ? std::atol(argv[1]) : 1024;
+    long steps = argc > 2 ? std::atol(argv[2]) : 20000000;
+    size_t bytes = std::max<size_t>(megabytes, 2) << 20;
+    bytes &= ~(kHugePageSize - 1);
+
+    int counter = open_dtlb_counter();
+    printf("bytes=%zu steps=%ld dtlb_counter=%s\n", bytes, steps,
+           counter >= 0 ? "on" : "unavailable");
+
+    auto* small = static_cast<char*>(mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (small == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+#ifdef MADV_NOHUGEPAGE
+    madvise(small, bytes, MADV_NOHUGEPAGE);
+#endif
+    memset(small, 1, bytes);
+    chase("4k pages", small, bytes, steps, counter);
+    munmap(small, bytes);
+
+    HugePageKind kind;
+    auto* huge = static_cast<char*>(map_huge_pages(bytes, kind));
+    if (!huge) {
+        perror("mmap");
+        return 1;
+    }
+    memset(huge, 1, bytes);
+    size_t backed = kind == HugePageKind::HugeTlb ? bytes : thp_resident_bytes();
+    printf("huge pages: %s, %.1f%% backed\n",
+           kind == HugePageKind::HugeTlb      ? "MAP_HUGETLB"
+           : kind == HugePageKind::Transparent ? "transparent"
+                                               : "unavailable",
+           100.0 * backed / bytes);
+    chase("huge pages", huge, bytes, steps, counter);
+    unmap_huge_pages(huge, bytes);
+
+    if (counter >= 0) close(counter);
+    return 0;
+}
@@ -0,0 +1,63 @@
+// What request tracing costs per request.
+//
+// Times a read of TickClock against steady_clock::now(), then the whole life
+// of one request's trace as VideoServer drives it for a small file: start,
+// a lookup, an open, a read and a send span, and the histogram updates when
+// it is dropped. Unsampled, as nearly every request is, and sampled.
+//
+//   trace_overhead [iterations=1000000]
+
+#include "tracing.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+template <typename Fn>
+static void time_it(const char* name, long iterations, Fn fn) {
+    uint64_t sink = 0;
+    auto start = Clock::now();
+    for (long i = 0; i < iterations; i++) sink += fn();
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    // Keeps the loop from being optimised away.
+    if (sink == 0) printf("?");
+    printf("%-22s %7.1f ns\n", name, ns / iterations);
+}
+
+static uint64_t one_request(RequestTracer& tracer, TraceStats& stats,
+                            const httplib::Request& req) {
+    auto trace = tracer.start(req, stats);
+    { auto span = trace->span(kLookup); }
+    { auto span = trace->span(kOpen); }
+    { auto span = trace->span(kRead); }
+    { auto span = trace->span(kSend); }
+    return stats.requests;
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = argc > 1 ? std::atol(argv[1]) : 1000000;
+    printf("clock=%s\n", httplib::detail::TickClock::tsc() ? "tsc" : "steady");
+
+    time_it("steady_clock::now", iterations, [] {
+        return static_cast<uint64_t>(Clock::now().time_since_epoch().count());
+    });
+    time_it("TickClock::now", iterations, [] { return httplib::detail::TickClock::now(); });
+
+    httplib::Request req;
+    req.method = "GET";
+    req.target = "/mov_bbb.mp4";
+    req.head_ticks_ = httplib::detail::TickClock::now();
+
+    auto stats = std::make_unique<TraceStats>();
+    RequestTracer unsampled(0);
+    time_it("request, unsampled", iterations,
+            [&] { return one_request(unsampled, *stats, req); });
+    RequestTracer sampled(1);
+    time_it("request, sampled", iterations / 10,
+            [&] { return one_request(sampled, *stats, req); });
+    return 0;
+}
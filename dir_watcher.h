@@ -0,0 +1,111 @@
+#pragma once
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+// Watches a directory tree with inotify and calls `on_added` whenever an
+// entry appears anywhere in it: created, moved in, or finished writing. New
+// subdirectories are watched as they appear. If inotify is unavailable the
+// watcher stays inactive, and callers fall back to their TTLs.
+//
+// Symlinked directories are not followed, so changes behind them go unseen.
+class DirWatcher {
+public:
+    DirWatcher(const fs::path& root, std::function<void()> on_added)
+        : on_added_(std::move(on_added)) {
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        stop_fd_ = eventfd(0, EFD_CLOEXEC);
+        if (fd_ < 0 || stop_fd_ < 0 || !watch_tree(root)) {
+            std::cerr << "⚠️  inotify unavailable for " << root
+                      << "; negative lookups expire by TTL only\n";
+            return;
+        }
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~DirWatcher() {
+        if (thread_.joinable()) {
+            uint64_t one = 1;
+            ssize_t n = write(stop_fd_, &one, sizeof(one));
+            (void)n;
+            thread_.join();
+        }
+        if (fd_ >= 0) close(fd_);
+        if (stop_fd_ >= 0) close(stop_fd_);
+    }
+
+    DirWatcher(const DirWatcher&) = delete;
+    DirWatcher& operator=(const DirWatcher&) = delete;
+
+    bool active() const { return thread_.joinable(); }
+
+private:
+    static constexpr uint32_t kMask =
+        IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR;
+
+    bool watch(const fs::path& dir) {
+        int wd = inotify_add_watch(fd_, dir.c_str(), kMask);
+        if (wd < 0) return false;
+        dirs_[wd] = dir;
+        return true;
+    }
+
+    bool watch_tree(const fs::path& root) {
+        if (!watch(root)) return false;
+        std::error_code ec;
+        for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end;
+             it.increment(ec)) {
+            if (it->is_directory(ec) && !it->is_symlink(ec) && !watch(it->path())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void run() {
+        alignas(inotify_event) char buf[16384];
+        pollfd fds[2] = {{fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+        for (;;) {
+            if (poll(fds, 2, -1) < 0) continue;
+            if (fds[1].revents) return;
+
+            bool added = false;
+            ssize_t n;
+            while ((n = read(fd_, buf, sizeof(buf))) > 0) {
+                for (char* p = buf; p < buf + n;) {
+                    auto* ev = reinterpret_cast<inotify_event*>(p);
+                    p += sizeof(inotify_event) + ev->len;
+                    // A lost event might have been an addition.
+                    if (ev->mask & IN_Q_OVERFLOW) added = true;
+                    if (ev->mask & (IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB)) {
+                        added = true;
+                    }
+                    if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+                        auto it = dirs_.find(ev->wd);
+                        if (it != dirs_.end()) watch_tree(it->second / ev->name);
+                    }
+                    if (ev->mask & IN_IGNORED) dirs_.erase(ev->wd);
+                }
+            }
+            if (added) on_added_();
+        }
+    }
+
+    std::function<void()> on_added_;
+    int fd_ = -1;
+    int stop_fd_ = -1;
+    std::unordered_map<int, fs::path> dirs_;
+    std::thread thread_;
+};
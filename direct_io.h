@@ -0,0 +1,140 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <sstream>
+#include <string>
+
+#include "huge_pages.h"
+
+// O_DIRECT transfers bypass the page cache, so a bulk download of a cold file
+// does not evict the cached heads of popular ones. They need buffers, offsets
+// and lengths aligned to the device's logical block size; 4096 satisfies
+// every common device. Blocks come from a HugePagePool, whose 2 MB regions
+// are aligned far beyond that.
+constexpr size_t kDirectAlign = 4096;
+constexpr size_t kDirectBlock = 1 << 20;
+
+// How responses were classified and how their bytes were read.
+struct IoStats {
+    std::atomic<uint64_t> direct_responses{0};
+    std::atomic<uint64_t> buffered_responses{0};
+    std::atomic<uint64_t> direct_bytes{0};
+    std::atomic<uint64_t> buffered_bytes{0};
+    std::atomic<uint64_t> spliced_bytes{0};
+    std::atomic<uint64_t> zerocopy_bytes{0};
+    std::atomic<uint64_t> direct_fallbacks{0};
+
+    void add_to(std::ostringstream& out) const {
+        out << "direct_responses " << direct_responses << "\n"
+            << "buffered_responses " << buffered_responses << "\n"
+            << "direct_bytes " << direct_bytes << "\n"
+            << "buffered_bytes " << buffered_bytes << "\n"
+            << "spliced_bytes " << spliced_bytes << "\n"
+            << "zerocopy_bytes " << zerocopy_bytes << "\n"
+            << "direct_fallbacks " << direct_fallbacks << "\n";
+    }
+};
+
+// Reads one file with O_DIRECT a whole aligned block at a time and serves
+// smaller reads out of the block. The kernel does no read-ahead for direct
+// descriptors, so large blocks are what keep the device busy.
+//
+// A block whose bytes went out with MSG_ZEROCOPY is still being read by the
+// kernel, so it is not refilled until `wait` reports those sends finished;
+// meanwhile the reader fills a second block. Nor does it go back to the pool
+// while pinned: a reader destroyed before unpin() retires its pinned blocks,
+// since the kernel may yet send from them, and the pool unmaps them.
+class DirectReader {
+public:
+    using WaitFn = std::function<bool(uint32_t count)>;
+
+    explicit DirectReader(HugePagePool& pool) : pool_(pool) {}
+
+    ~DirectReader() {
+        if (fd_ >= 0) close(fd_);
+        for (auto& block : blocks_) {
+            if (block.pinned) {
+                pool_.retire(block.buffer);
+            } else {
+                pool_.put(block.buffer);
+            }
+        }
+    }
+
+    DirectReader(const DirectReader&) = delete;
+    DirectReader& operator=(const DirectReader&) = delete;
+
+    // False where the filesystem refuses O_DIRECT (tmpfs, some overlays).
+    bool open(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+        if (fd_ < 0) return false;
+        blocks_[0].buffer = pool_.get();
+        return blocks_[0].buffer != nullptr;
+    }
+
+    // Returns up to `len` bytes at `offset`, setting `len` to how many are
+    // available there; nullptr on a read error, at end of file, or if a
+    // pinned block could not be released. After a read error, refused()
+    // tells whether the filesystem rejects direct reads of the file, as some
+    // accept the O_DIRECT open and then fail every read with EINVAL.
+    const char* read(size_t offset, size_t& len, const WaitFn& wait = nullptr) {
+        auto* block = &blocks_[current_];
+        if (offset < block->start || offset >= block->start + block->filled) {
+            if (block->pinned) {
+                current_ ^= 1;
+                block = &blocks_[current_];
+            }
+            if (block->pinned) {
+                if (!wait || !wait(block->pinned_until)) return nullptr;
+                block->pinned = false;
+            }
+            if (!block->buffer && !(block->buffer = pool_.get())) return nullptr;
+
+            block->start = offset & ~(kDirectAlign - 1);
+            block->filled = 0;
+            ssize_t n = pread(fd_, block->buffer, kDirectBlock, block->start);
+            if (n < 0 && errno == EINVAL) refused_ = true;
+            if (n <= 0 || offset >= block->start + static_cast<size_t>(n)) return nullptr;
+            block->filled = static_cast<size_t>(n);
+        }
+        len = std::min(len, block->start + block->filled - offset);
+        return block->buffer + (offset - block->start);
+    }
+
+    // Records that the current block is read by zerocopy sends up to the
+    // `count`th.
+    void pin(uint32_t count) {
+        blocks_[current_].pinned = true;
+        blocks_[current_].pinned_until = count;
+    }
+
+    bool refused() const { return refused_; }
+
+    bool pinned() const { return blocks_[0].pinned || blocks_[1].pinned; }
+
+    // Call once every zerocopy send has been reported finished.
+    void unpin() {
+        for (auto& block : blocks_) block.pinned = false;
+    }
+
+private:
+    struct Block {
+        char* buffer = nullptr;
+        size_t start = 0;
+        size_t filled = 0;
+        bool pinned = false;
+        uint32_t pinned_until = 0;
+    };
+
+    HugePagePool& pool_;
+    int fd_ = -1;
+    Block blocks_[2];
+    int current_ = 0;
+    bool refused_ = false;
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <httplib.h>
+
+#include "header_block.h"
+#include "mp4_index.h"
+
+namespace fs = std::filesystem;
+
+// Everything the server needs to describe a file without opening it.
+struct FileInfo {
+    fs::path path;
+    size_t size = 0;
+    time_t mtime = 0;
+    std::string content_type;
+    std::string etag;
+    std::string last_modified;
+    HeaderTemplate headers;
+
+    // Average bitrate in bytes/s from the MP4 index, 0 if unknown. Resolved on
+    // first use so that HEAD and stat revalidation never read the file.
+    uint64_t byte_rate() const {
+        std::call_once(byte_rate_once_,
+                       [this] { byte_rate_ = mp4::byte_rate(path, size); });
+        return byte_rate_;
+    }
+
+private:
+    mutable std::once_flag byte_rate_once_;
+    mutable uint64_t byte_rate_ = 0;
+};
+
+// Same text as strftime("%a, %d %b %Y %H:%M:%S GMT") without its locale and
+// timezone lookups; the Date header comes from the same formatter.
+inline std::string format_http_date(time_t t) { return httplib::detail::format_http_date(t); }
+
+inline std::string get_mime_type(const fs::path& path) {
+    std::string ext = path.extension().string();
+    if (ext == ".mp4") return "video/mp4";
+    if (ext == ".webm") return "video/webm";
+    if (ext == ".mkv") return "video/x-matroska";
+    if (ext == ".mov") return "video/quicktime";
+    return "application/octet-stream";
+}
+
+// Caches stat() results per path. Entries are trusted for `ttl` and then
+// revalidated with a fresh stat; the file itself is never opened here.
+class FileCache {
+public:
+    explicit FileCache(std::chrono::milliseconds ttl = std::chrono::seconds(1),
+                       size_t max_entries = 65536)
+        : ttl_(ttl), max_entries_(max_entries) {}
+
+    // Returns nullptr when the path does not name a regular file.
+    std::shared_ptr<const FileInfo> lookup(const fs::path& path) {
+        return lookup(path, [](const std::string&) { return false; });
+    }
+
+    // As above, but a path the cache holds nothing for is reported missing
+    // without a stat when `known_missing` says so. A path it holds is always
+    // checked as usual, whatever `known_missing` would say.
+    template <typename KnownMissing>
+    std::shared_ptr<const FileInfo> lookup(const fs::path& path,
+                                           const KnownMissing& known_missing) {
+        auto now = std::chrono::steady_clock::now();
+        const std::string& key = path.native();
+
+        bool cached;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(key);
+            if (it != entries_.end() && now - it->second.checked < ttl_) {
+                return it->second.info;
+            }
+            cached = it != entries_.end();
+        }
+        if (!cached && known_missing(key)) return nullptr;
+
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_.erase(key);
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = entries_[key];
+        if (!entry.info || entry.info->size != static_cast<size_t>(st.st_size) ||
+            entry.info->mtime != st.st_mtime) {
+            if (entries_.size() > max_entries_) {
+                entries_.clear();
+                return make_info(path, st);
+            }
+            entry.info = make_info(path, st);
+        }
+        entry.checked = now;
+        return entry.info;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<const FileInfo> info;
+        std::chrono::steady_clock::time_point checked;
+    };
+
+    static std::shared_ptr<const FileInfo> make_info(const fs::path& path,
+                                                     const struct stat& st) {
+        auto info = std::make_shared<FileInfo>();
+        info->path = path;
+        info->size = st.st_size;
+        info->mtime = st.st_mtime;
+        info->content_type = get_mime_type(path);
+
+        char etag[64];
+        snprintf(etag, sizeof(etag), "\"%lx-%lx\"",
+                 static_cast<unsigned long>(st.st_mtime),
+                 static_cast<unsigned long>(st.st_size));
+        info->etag = etag;
+        info->last_modified = format_http_date(st.st_mtime);
+        info->headers = HeaderTemplate(info->content_type, info->size,
+                                       info->etag, info->last_modified);
+        return info;
+    }
+
+    std::chrono::milliseconds ttl_;
+    size_t max_entries_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+};
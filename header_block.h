@@ -0,0 +1,51 @@
+#pragma once
+
+#include <charconv>
+#include <string>
+
+// Pre-serialized representation headers for one file. The 200 block is built
+// once; a 206 block copies the shared lines and patches in the range numbers.
+class HeaderTemplate {
+public:
+    HeaderTemplate() = default;
+
+    HeaderTemplate(const std::string& content_type, size_t size,
+                   const std::string& etag, const std::string& last_modified) {
+        common_ = "Content-Type: " + content_type + "\r\n"
+                  "Accept-Ranges: bytes\r\n"
+                  "ETag: " + etag + "\r\n"
+                  "Last-Modified: " + last_modified + "\r\n";
+        full_ = common_ + "Content-Length: " + std::to_string(size) + "\r\n";
+        size_suffix_ = "/" + std::to_string(size) + "\r\n";
+    }
+
+    const std::string& full() const { return full_; }
+
+    std::string range(size_t first, size_t last) const {
+        std::string block;
+        block.reserve(common_.size() + range_lines_max_ + size_suffix_.size());
+        block += common_;
+        block += "Content-Length: ";
+        append_number(block, last - first + 1);
+        block += "\r\nContent-Range: bytes ";
+        append_number(block, first);
+        block += '-';
+        append_number(block, last);
+        block += size_suffix_;
+        return block;
+    }
+
+private:
+    static void append_number(std::string& s, size_t n) {
+        char buf[24];
+        auto result = std::to_chars(buf, buf + sizeof(buf), n);
+        s.append(buf, result.ptr);
+    }
+
+    // "Content-Length: " + "\r\nContent-Range: bytes " + three numbers + '-'
+    static constexpr size_t range_lines_max_ = 16 + 23 + 3 * 20 + 1;
+
+    std::string common_;
+    std::string full_;
+    std::string size_suffix_;
+};
@@ -22,6 +22,10 @@
 #define CPPHTTPLIB_KEEPALIVE_TIMEOUT_CHECK_INTERVAL_USECOND 10000
 #endif
 
+#ifndef CPPHTTPLIB_TIMER_WHEEL_TICK_MSECOND
+#define CPPHTTPLIB_TIMER_WHEEL_TICK_MSECOND 10
+#endif
+
 #ifndef CPPHTTPLIB_KEEPALIVE_MAX_COUNT
 #define CPPHTTPLIB_KEEPALIVE_MAX_COUNT 100
 #endif
@@ -50,6 +54,10 @@
 #define CPPHTTPLIB_SERVER_WRITE_TIMEOUT_USECOND 0
 #endif
 
+#ifndef CPPHTTPLIB_SERVER_MIN_RATE_GRACE_SECOND
+#define CPPHTTPLIB_SERVER_MIN_RATE_GRACE_SECOND 5
+#endif
+
 #ifndef CPPHTTPLIB_CLIENT_READ_TIMEOUT_SECOND
 #define CPPHTTPLIB_CLIENT_READ_TIMEOUT_SECOND 300
 #endif
@@ -90,6 +98,18 @@
 #define CPPHTTPLIB_HEADER_MAX_LENGTH 8192
 #endif
 
+#ifndef CPPHTTPLIB_HEADER_MAX_COUNT
+#define CPPHTTPLIB_HEADER_MAX_COUNT 100
+#endif
+
+#ifndef CPPHTTPLIB_HEADERS_INLINE_COUNT
+#define CPPHTTPLIB_HEADERS_INLINE_COUNT 16
+#endif
+
+#ifndef CPPHTTPLIB_REQUEST_HEAD_MAX_LENGTH
+#define CPPHTTPLIB_REQUEST_HEAD_MAX_LENGTH 65536
+#endif
+
 #ifndef CPPHTTPLIB_REDIRECT_MAX_COUNT
 #define CPPHTTPLIB_REDIRECT_MAX_COUNT 20
 #endif
@@ -110,6 +130,14 @@
 #define CPPHTTPLIB_RANGE_MAX_COUNT 1024
 #endif
 
+#ifndef CPPHTTPLIB_PIPELINE_BUFFER_SIZE
+#define CPPHTTPLIB_PIPELINE_BUFFER_SIZE 65536
+#endif
+
+#ifndef CPPHTTPLIB_HTTP2_MAX_CONCURRENT_STREAMS
+#define CPPHTTPLIB_HTTP2_MAX_CONCURRENT_STREAMS 100
+#endif
+
 #ifndef CPPHTTPLIB_TCP_NODELAY
 #define CPPHTTPLIB_TCP_NODELAY false
 #endif
@@ -122,6 +150,14 @@
 #define CPPHTTPLIB_RECV_BUFSIZ size_t(16384u)
 #endif
 
+#ifndef CPPHTTPLIB_SEND_BUFSIZ
+#define CPPHTTPLIB_SEND_BUFSIZ size_t(16384u)
+#endif
+
+#ifndef CPPHTTPLIB_SEND_BUFSIZ_MAX
+#define CPPHTTPLIB_SEND_BUFSIZ_MAX size_t(262144u)
+#endif
+
 #ifndef CPPHTTPLIB_COMPRESSION_BUFSIZ
 #define CPPHTTPLIB_COMPRESSION_BUFSIZ size_t(16384u)
 #endif
@@ -217,11 +253,12 @@ using socklen_t = int;
 #include <resolv.h>
 #endif
 #include <netinet/tcp.h>
-#ifdef CPPHTTPLIB_USE_POLL
+#if defined(CPPHTTPLIB_USE_POLL) || defined(__linux__)
 #include <poll.h>
 #endif
 #include <csignal>
 #include <pthread.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #ifndef __VMS
 #include <sys/select.h>
@@ -244,6 +281,7 @@ using socket_t = int;
 #include <climits>
 #include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <errno.h>
 #include <exception>
 #include <fcntl.h>
@@ -266,6 +304,51 @@ using socket_t = int;
 #include <unordered_set>
 #include <utility>
 
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__)) && !defined(CPPHTTPLIB_NO_SIMD)
+#define CPPHTTPLIB_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__)) && !defined(CPPHTTPLIB_NO_TSC)
+#define CPPHTTPLIB_TSC
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+// USDT probes for bpftrace, perf and SystemTap, where systemtap's sys/sdt.h
+// is installed. Each is a nop and a note in the binary until a tracer
+// attaches; without the header they compile to nothing.
+#if defined(__has_include) && !defined(CPPHTTPLIB_NO_USDT)
+#if __has_include(<sys/sdt.h>)
+#define CPPHTTPLIB_USDT
+#include <sys/sdt.h>
+#endif
+#endif
+
+#ifdef CPPHTTPLIB_USDT
+#define CPPHTTPLIB_PROBE1(name, a) DTRACE_PROBE1(httplib, name, a)
+#define CPPHTTPLIB_PROBE3(name, a, b, c) DTRACE_PROBE3(httplib, name, a, b, c)
+#define CPPHTTPLIB_PROBE4(name, a, b, c, d)                                    \
+  DTRACE_PROBE4(httplib, name, a, b, c, d)
+#else
+#define CPPHTTPLIB_PROBE1(name, a) ((void)0)
+#define CPPHTTPLIB_PROBE3(name, a, b, c) ((void)0)
+#define CPPHTTPLIB_PROBE4(name, a, b, c, d) ((void)0)
+#endif
+
+#if defined(__linux__) && !defined(CPPHTTPLIB_NO_SPLICE)
+#define CPPHTTPLIB_SPLICE
+#endif
+
+#if defined(__linux__) && !defined(CPPHTTPLIB_NO_ZEROCOPY)
+#include <linux/errqueue.h>
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define CPPHTTPLIB_ZEROCOPY
+#endif
+#endif
+
 #ifdef CPPHTTPLIB_OPENSSL_SUPPORT
 #ifdef _WIN32
 #include <wincrypt.h>
@@ -510,9 +593,286 @@ enum StatusCode {
   NetworkAuthenticationRequired_511 = 511,
 };
 
-using Headers =
-    std::unordered_multimap<std::string, std::string, detail::case_ignore::hash,
-                            detail::case_ignore::equal_to>;
+/*
+ * A case-insensitive multimap of header fields, stored flat.
+ *
+ * Fields live in one array, in insertion order, with fields of equal name
+ * kept next to each other so equal_range() works as it does for a multimap.
+ * A parallel array holds the hash of each lowercased name, so lookups compare
+ * integers first and case-fold only on a hash match. The first
+ * CPPHTTPLIB_HEADERS_INLINE_COUNT fields are stored inside the object, so a
+ * typical request or response needs no allocation beyond its strings.
+ *
+ * Removed fields are kept as spares and later fields are assigned into them,
+ * so a cleared container refilled with similar headers reuses the strings'
+ * storage.
+ *
+ * Field names must not be modified through an iterator.
+ */
+class Headers {
+public:
+  using value_type = std::pair<std::string, std::string>;
+  using iterator = value_type *;
+  using const_iterator = const value_type *;
+  using size_type = size_t;
+
+  Headers() = default;
+
+  Headers(std::initializer_list<value_type> fields) {
+    reserve(fields.size());
+    for (const auto &f : fields) {
+      emplace(f.first, f.second);
+    }
+  }
+
+  Headers(const Headers &rhs) { *this = rhs; }
+
+  Headers(Headers &&rhs) noexcept { take(rhs); }
+
+  ~Headers() { release(); }
+
+  Headers &operator=(const Headers &rhs) {
+    if (this != &rhs) {
+      size_ = 0;
+      reserve(rhs.size_);
+      for (size_t i = 0; i < rhs.size_; i++) {
+        auto &f = next_slot();
+        f.first = rhs.data_[i].first;
+        f.second = rhs.data_[i].second;
+        hashes_[i] = rhs.hashes_[i];
+        size_++;
+      }
+    }
+    return *this;
+  }
+
+  Headers &operator=(Headers &&rhs) noexcept {
+    if (this != &rhs) {
+      release();
+      take(rhs);
+    }
+    return *this;
+  }
+
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  void clear() { size_ = 0; }
+
+  iterator find(const std::string &key) {
+    return data_ + index_of(key, hash_of(key));
+  }
+
+  const_iterator find(const std::string &key) const {
+    return data_ + index_of(key, hash_of(key));
+  }
+
+  size_t count(const std::string &key) const {
+    auto r = equal_range(key);
+    return static_cast<size_t>(r.second - r.first);
+  }
+
+  std::pair<iterator, iterator> equal_range(const std::string &key) {
+    auto r = range_of(key);
+    return {data_ + r.first, data_ + r.second};
+  }
+
+  std::pair<const_iterator, const_iterator>
+  equal_range(const std::string &key) const {
+    auto r = range_of(key);
+    return {data_ + r.first, data_ + r.second};
+  }
+
+  template <typename K, typename V> iterator emplace(K &&key, V &&val) {
+    auto &f = next_slot();
+    f.first = std::forward<K>(key);
+    f.second = std::forward<V>(val);
+    return link_last();
+  }
+
+  // Adds a field from character ranges, copying into a spare field's storage
+  // when there is one.
+  iterator emplace(const char *key, size_t key_len, const char *val,
+                   size_t val_len) {
+    auto &f = next_slot();
+    f.first.assign(key, key_len);
+    f.second.assign(val, val_len);
+    return link_last();
+  }
+
+  iterator insert(const value_type &field) {
+    return emplace(field.first, field.second);
+  }
+
+  iterator insert(value_type &&field) {
+    return emplace(std::move(field.first), std::move(field.second));
+  }
+
+  template <typename It> void insert(It first, It last) {
+    for (; first != last; ++first) {
+      insert(*first);
+    }
+  }
+
+  iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+
+  iterator erase(const_iterator first, const_iterator last) {
+    auto f = static_cast<size_t>(first - data_);
+    auto l = static_cast<size_t>(last - data_);
+    if (f != l) {
+      std::rotate(data_ + f, data_ + l, data_ + size_);
+      std::move(hashes_ + l, hashes_ + size_, hashes_ + f);
+      size_ -= l - f;
+    }
+    return data_ + f;
+  }
+
+  size_t erase(const std::string &key) {
+    auto r = equal_range(key);
+    auto n = static_cast<size_t>(r.second - r.first);
+    erase(r.first, r.second);
+    return n;
+  }
+
+  // Fields and hashes share one heap block once the inline space is full.
+  void reserve(size_t n) {
+    if (n <= capacity_) { return; }
+    auto block = ::operator new(n * (sizeof(value_type) + sizeof(size_t)));
+    auto data = static_cast<value_type *>(block);
+    auto hashes = reinterpret_cast<size_t *>(data + n);
+    for (size_t i = 0; i < constructed_; i++) {
+      new (data + i) value_type(std::move(data_[i]));
+      hashes[i] = hashes_[i];
+    }
+    auto size = size_;
+    auto constructed = constructed_;
+    destroy();
+    size_ = size;
+    constructed_ = constructed;
+    data_ = data;
+    hashes_ = hashes;
+    capacity_ = n;
+  }
+
+private:
+  static size_t hash_of(const std::string &key) {
+    return detail::case_ignore::hash()(key);
+  }
+
+  bool matches(size_t i, const std::string &key, size_t h) const {
+    return hashes_[i] == h && detail::case_ignore::equal(data_[i].first, key);
+  }
+
+  size_t index_of(const std::string &key, size_t h) const {
+    auto first = hashes_;
+    auto last = hashes_ + size_;
+    for (auto p = first; (p = std::find(p, last, h)) != last; ++p) {
+      auto i = static_cast<size_t>(p - first);
+      if (detail::case_ignore::equal(data_[i].first, key)) { return i; }
+    }
+    return size_;
+  }
+
+  std::pair<size_t, size_t> range_of(const std::string &key) const {
+    auto h = hash_of(key);
+    auto first = index_of(key, h);
+    auto last = first;
+    while (last < size_ && matches(last, key, h)) {
+      last++;
+    }
+    return {first, last};
+  }
+
+  // The slot past the last field: a spare, or a newly constructed field.
+  value_type &next_slot() {
+    if (size_ == capacity_) { reserve(capacity_ * 2); }
+    if (size_ == constructed_) {
+      new (data_ + size_) value_type();
+      constructed_++;
+    }
+    return data_[size_];
+  }
+
+  // Adds the field in next_slot() to the container, moving it up behind any
+  // fields of the same name.
+  iterator link_last() {
+    const auto &key = data_[size_].first;
+    auto h = hash_of(key);
+    auto i = index_of(key, h);
+    while (i < size_ && matches(i, key, h)) {
+      i++;
+    }
+    if (i < size_) {
+      std::rotate(data_ + i, data_ + size_, data_ + size_ + 1);
+      std::move_backward(hashes_ + i, hashes_ + size_, hashes_ + size_ + 1);
+    }
+    hashes_[i] = h;
+    size_++;
+    return data_ + i;
+  }
+
+  bool is_inline() const {
+    return data_ == reinterpret_cast<const value_type *>(&inline_data_);
+  }
+
+  void reset_inline() {
+    data_ = reinterpret_cast<value_type *>(&inline_data_);
+    hashes_ = inline_hashes_;
+    capacity_ = CPPHTTPLIB_HEADERS_INLINE_COUNT;
+  }
+
+  // Destroys every field, spares included, and frees a heap block.
+  void destroy() {
+    for (size_t i = 0; i < constructed_; i++) {
+      data_[i].~value_type();
+    }
+    if (!is_inline()) { ::operator delete(data_); }
+    size_ = constructed_ = 0;
+  }
+
+  void release() {
+    destroy();
+    reset_inline();
+  }
+
+  // Takes the fields of `rhs` and leaves it empty. A heap block is handed
+  // over whole, spares and all; inline fields are moved one by one.
+  void take(Headers &rhs) {
+    if (!rhs.is_inline()) {
+      data_ = rhs.data_;
+      hashes_ = rhs.hashes_;
+      capacity_ = rhs.capacity_;
+      size_ = rhs.size_;
+      constructed_ = rhs.constructed_;
+      rhs.reset_inline();
+      rhs.size_ = rhs.constructed_ = 0;
+    } else {
+      for (size_t i = 0; i < rhs.size_; i++) {
+        new (data_ + i) value_type(std::move(rhs.data_[i]));
+        hashes_[i] = rhs.hashes_[i];
+      }
+      size_ = constructed_ = rhs.size_;
+      rhs.clear();
+    }
+  }
+
+  typename std::aligned_storage<sizeof(value_type) *
+                                    CPPHTTPLIB_HEADERS_INLINE_COUNT,
+                                alignof(value_type)>::type inline_data_;
+  size_t inline_hashes_[CPPHTTPLIB_HEADERS_INLINE_COUNT];
+  value_type *data_ = reinterpret_cast<value_type *>(&inline_data_);
+  size_t *hashes_ = inline_hashes_;
+  size_t size_ = 0;
+  size_t constructed_ = 0;
+  size_t capacity_ = CPPHTTPLIB_HEADERS_INLINE_COUNT;
+};
 
 using Params = std::multimap<std::string, std::string>;
 using Match = std::smatch;
@@ -546,6 +906,30 @@ public:
   std::function<void(const Headers &trailer)> done_with_trailer;
   std::ostream os;
 
+  // Payload the socket send buffer can take at once; providers that read
+  // from disk can size their chunks to it.
+  size_t preferred_write_size = CPPHTTPLIB_SEND_BUFSIZ;
+
+  // The connection being written to, for per-connection socket options such
+  // as pacing. Payload must still go through write() or write_file().
+  socket_t socket = INVALID_SOCKET;
+
+  // Sends `length` bytes of the file `fd` from `offset` without copying them
+  // through user space. Empty when the body must pass through user space
+  // anyway: TLS, chunked or compressed responses.
+  std::function<bool(int fd, size_t offset, size_t length)> write_file;
+
+  // Sends `data` with MSG_ZEROCOPY: the kernel transmits the bytes in place
+  // instead of copying them, so they must stay unchanged until
+  // zerocopy_wait() covers the send. The body's sends are all covered
+  // before the response ends. Empty where unsupported; below a few tens of
+  // KB a copy is cheaper than the page pinning and completion it replaces.
+  std::function<bool(const char *data, size_t data_len)> write_zerocopy;
+  // Zerocopy sends issued so far for this body.
+  std::function<uint32_t()> zerocopy_issued;
+  // Blocks until the kernel has released the first `count` zerocopy sends.
+  std::function<bool(uint32_t count)> zerocopy_wait;
+
 private:
   class data_sink_streambuf final : public std::streambuf {
   public:
@@ -636,6 +1020,10 @@ struct Request {
   Match matches;
   std::unordered_map<std::string, std::string> path_params;
   std::function<bool()> is_connection_closed = []() { return true; };
+  // Kept across a connection's keep-alive requests and dropped when it
+  // closes, for handlers that track state per connection. Each HTTP/2
+  // stream starts with an empty one.
+  mutable std::shared_ptr<void> connection_data;
 
   // for client
   ResponseHandler response_handler;
@@ -671,6 +1059,11 @@ struct Request {
   size_t authorization_count_ = 0;
   std::chrono::time_point<std::chrono::steady_clock> start_time_ =
       (std::chrono::steady_clock::time_point::min)();
+  // detail::TickClock readings for the server: how long the connection
+  // waited for a worker (first request only, else 0), and when this
+  // request's head had been read.
+  uint64_t queue_ticks_ = 0;
+  uint64_t head_ticks_ = 0;
 };
 
 struct Response {
@@ -706,6 +1099,13 @@ struct Response {
       const std::string &content_type, ContentProviderWithoutLength provider,
       ContentProviderResourceReleaser resource_releaser = nullptr);
 
+  // `header_block` holds pre-serialized "Name: value\r\n" lines, including
+  // Content-Type and Content-Length. They are sent verbatim, and the Range
+  // header is left to the handler: the provider serves exactly `length` bytes.
+  void set_content_provider_with_header_block(
+      size_t length, std::string header_block, ContentProvider provider,
+      ContentProviderResourceReleaser resource_releaser = nullptr);
+
   void set_file_content(const std::string &path,
                         const std::string &content_type);
   void set_file_content(const std::string &path);
@@ -727,8 +1127,10 @@ struct Response {
   ContentProviderResourceReleaser content_provider_resource_releaser_;
   bool is_chunked_content_provider_ = false;
   bool content_provider_success_ = false;
+  std::string header_block_;
   std::string file_content_path_;
   std::string file_content_content_type_;
+  std::string head_buffer_;
 };
 
 class Stream {
@@ -740,12 +1142,38 @@ public:
 
   virtual ssize_t read(char *ptr, size_t size) = 0;
   virtual ssize_t write(const char *ptr, size_t size) = 0;
+  virtual ssize_t writev(const char *ptr1, size_t size1, const char *ptr2,
+                         size_t size2);
   virtual void get_remote_ip_and_port(std::string &ip, int &port) const = 0;
   virtual void get_local_ip_and_port(std::string &ip, int &port) const = 0;
   virtual socket_t socket() const = 0;
 
   virtual time_t duration() const = 0;
 
+  // Reads through the blank line that ends a message head, leaving anything
+  // after it unread. Returns false on EOF or error before the head ends; a
+  // head longer than `max` is returned truncated.
+  virtual bool read_head(std::string &head, size_t max);
+
+  // True when bytes from the peer sit read but unconsumed, such as a
+  // pipelined request behind the one being served.
+  virtual bool has_buffered_input() const { return false; }
+
+  // Sends `size` bytes of the file `fd` from `offset` without copying them
+  // through user space, when can_write_file() says the stream is able to.
+  // Returns the bytes sent, or -1 on error.
+  virtual bool can_write_file() const { return false; }
+  virtual ssize_t write_file(int fd, size_t offset, size_t size);
+
+  // MSG_ZEROCOPY sends; see DataSink::write_zerocopy. Streams that cannot
+  // send in place copy instead and have nothing to wait for.
+  virtual bool can_write_zerocopy() const { return false; }
+  virtual ssize_t write_zerocopy(const char *ptr, size_t size) {
+    return write(ptr, size);
+  }
+  virtual uint32_t zerocopy_issued() const { return 0; }
+  virtual bool wait_zerocopy(uint32_t /*count*/) { return true; }
+
   ssize_t write(const char *ptr);
   ssize_t write(const std::string &s);
 };
@@ -845,6 +1273,165 @@ private:
   std::mutex mutex_;
 };
 
+// A thread pool split into shards that share nothing: each shard has its own
+// job queue and worker threads, pinned where the platform allows to a set of
+// CPUs no other shard uses. The CPUs are split into contiguous runs, one per
+// shard; with more shards than CPUs, shards take turns on them. A connection
+// runs to completion on the shard it is handed to, so state keyed by
+// current_shard() is only ever touched from that shard's CPUs. New
+// connections go to the shard with the fewest in progress.
+//
+// The workers block on their connections' sockets, so a shard needs several
+// to keep its CPUs busy; they share the shard's set.
+class ShardedThreadPool final : public TaskQueue {
+public:
+  ShardedThreadPool(size_t shards, size_t threads_per_shard, bool pin = true,
+                    size_t mqr = 0)
+      : shards_(shards), max_queued_requests_(mqr) {
+    auto cpus = usable_cpus();
+    auto n = cpus.size();
+    for (size_t i = 0; i < shards_.size(); i++) {
+      auto &shard = shards_[i];
+      if (pin && n > 0) {
+        if (shards_.size() <= n) {
+          for (auto c = i * n / shards_.size(); c < (i + 1) * n / shards_.size();
+               c++) {
+            shard.cpus.push_back(cpus[c]);
+          }
+        } else {
+          shard.cpus.push_back(cpus[i % n]);
+        }
+      }
+      for (size_t n = 0; n < threads_per_shard; n++) {
+        shard.threads.emplace_back([this, i] { work(i); });
+      }
+    }
+  }
+
+  ShardedThreadPool(const ShardedThreadPool &) = delete;
+  ~ShardedThreadPool() override = default;
+
+  // Index of the shard running the calling thread, or -1 outside the pool.
+  static int current_shard() { return this_shard(); }
+
+  size_t shard_count() const { return shards_.size(); }
+  // Empty when the shard is not pinned.
+  const std::vector<int> &shard_cpus(size_t i) const {
+    return shards_[i].cpus;
+  }
+  size_t shard_load(size_t i) const { return shards_[i].load; }
+
+  bool enqueue(std::function<void()> fn) override {
+    auto n = shards_.size();
+    auto start = next_++ % n;
+    auto best = start;
+    for (size_t k = 1; k < n; k++) {
+      auto i = (start + k) % n;
+      if (shards_[i].load < shards_[best].load) { best = i; }
+    }
+
+    auto &shard = shards_[best];
+    {
+      std::unique_lock<std::mutex> lock(shard.mutex);
+      if (max_queued_requests_ > 0 &&
+          shard.jobs.size() >= max_queued_requests_) {
+        return false;
+      }
+      shard.jobs.push_back(std::move(fn));
+      shard.load++;
+    }
+    shard.cond.notify_one();
+    return true;
+  }
+
+  void shutdown() override {
+    for (auto &shard : shards_) {
+      {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        shard.shutdown = true;
+      }
+      shard.cond.notify_all();
+    }
+    for (auto &shard : shards_) {
+      for (auto &t : shard.threads) {
+        t.join();
+      }
+    }
+  }
+
+private:
+  // Each shard sits on its own cache lines, so CPUs never share one for
+  // queue bookkeeping.
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::list<std::function<void()>> jobs;
+    std::atomic<size_t> load{0}; // queued or running
+    bool shutdown = false;
+    std::vector<int> cpus;
+    std::vector<std::thread> threads;
+  };
+
+  static int &this_shard() {
+    static thread_local int index = -1;
+    return index;
+  }
+
+  static std::vector<int> usable_cpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) { cpus.push_back(cpu); }
+      }
+    }
+#endif
+    return cpus;
+  }
+
+  void work(size_t i) {
+    auto &shard = shards_[i];
+    this_shard() = static_cast<int>(i);
+#ifdef __linux__
+    if (!shard.cpus.empty()) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (auto cpu : shard.cpus) {
+        CPU_SET(cpu, &set);
+      }
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+
+    for (;;) {
+      std::function<void()> fn;
+      {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        shard.cond.wait(lock,
+                        [&] { return !shard.jobs.empty() || shard.shutdown; });
+        if (shard.shutdown && shard.jobs.empty()) { break; }
+        fn = std::move(shard.jobs.front());
+        shard.jobs.pop_front();
+      }
+
+      assert(true == static_cast<bool>(fn));
+      fn();
+      shard.load--;
+    }
+
+#if defined(CPPHTTPLIB_OPENSSL_SUPPORT) && !defined(OPENSSL_IS_BORINGSSL) &&   \
+    !defined(LIBRESSL_VERSION_NUMBER)
+    OPENSSL_thread_stop();
+#endif
+  }
+
+  std::vector<Shard> shards_;
+  std::atomic<size_t> next_{0};
+  size_t max_queued_requests_ = 0;
+};
+
 using Logger = std::function<void(const Request &, const Response &)>;
 
 using SocketOptions = std::function<void(socket_t sock)>;
@@ -857,6 +1444,21 @@ bool set_socket_opt(socket_t sock, int level, int optname, int opt);
 bool set_socket_opt_time(socket_t sock, int level, int optname, time_t sec,
                          time_t usec);
 
+class TimerWheel;
+
+namespace http2 {
+struct BodyPiece;
+} // namespace http2
+
+// Floor on how fast a peer sends a request or drains a response. It is judged
+// against the time the stream spends waiting on the peer, not wall time, so
+// pauses on the server side never count against the client.
+struct MinRate {
+  size_t bytes_per_sec = 0; // 0 disables the floor
+  time_t grace_sec = CPPHTTPLIB_SERVER_MIN_RATE_GRACE_SECOND;
+  std::atomic<size_t> *violations = nullptr;
+};
+
 } // namespace detail
 
 void default_socket_options(socket_t sock);
@@ -932,6 +1534,83 @@ private:
   std::regex regex_;
 };
 
+/**
+ * Radix tree of literal and prefix routes, keyed by path.
+ *
+ * find() walks the path once and returns the lowest route number among the
+ * exact route for the whole path and the prefix routes along the way, so its
+ * cost depends on the path length, not on the number of routes.
+ */
+class RouteTree {
+public:
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  void insert(const std::string &key, bool prefix, size_t route);
+  size_t find(const std::string &path) const;
+
+private:
+  struct Node {
+    std::string label;
+    size_t exact = npos;
+    size_t prefix = npos;
+    std::vector<std::unique_ptr<Node>> children;
+  };
+
+  Node root_;
+};
+
+/*
+ * Reads a route pattern that a regex would match literally: plain text, or
+ * plain text followed by ".*" for a prefix route. A backslash before a
+ * character other than a letter or digit escapes it. Returns false for
+ * anything else, which stays a regex.
+ */
+bool parse_literal_route(const std::string &pattern, std::string &key,
+                         bool &prefix);
+
+/**
+ * The routes registered for one method, dispatched in registration order.
+ *
+ * Literal and prefix routes are looked up in a RouteTree; regex and path
+ * parameter routes are tried one by one, but only those registered before
+ * the tree's match. Literal and prefix routes leave Request::matches empty.
+ */
+template <typename Handler> class RouteTable {
+public:
+  void add(const std::string &pattern, Handler handler) {
+    auto route = handlers_.size();
+    std::string key;
+    bool prefix = false;
+    if (pattern.find("/:") != std::string::npos) {
+      matchers_.emplace_back(route,
+                             detail::make_unique<PathParamsMatcher>(pattern));
+    } else if (parse_literal_route(pattern, key, prefix)) {
+      tree_.insert(key, prefix, route);
+    } else {
+      matchers_.emplace_back(route, detail::make_unique<RegexMatcher>(pattern));
+    }
+    handlers_.push_back(std::move(handler));
+  }
+
+  // Returns the first route matching the request path, or nullptr.
+  const Handler *find(Request &req) const {
+    auto route = tree_.find(req.path);
+    for (const auto &x : matchers_) {
+      if (x.first > route) { break; }
+      if (x.second->match(req)) { return &handlers_[x.first]; }
+    }
+    if (route == RouteTree::npos) { return nullptr; }
+    req.matches = Match();
+    req.path_params.clear();
+    return &handlers_[route];
+  }
+
+private:
+  std::vector<Handler> handlers_;
+  std::vector<std::pair<size_t, std::unique_ptr<MatcherBase>>> matchers_;
+  RouteTree tree_;
+};
+
 ssize_t write_headers(Stream &strm, const Headers &headers);
 
 } // namespace detail
@@ -1023,6 +1702,23 @@ public:
 
   Server &set_payload_max_length(size_t length);
 
+  // Connections that send requests or drain responses slower than these
+  // rates, once the grace period is used up, are closed and counted.
+  Server &set_min_request_rate(
+      size_t bytes_per_sec,
+      time_t grace_sec = CPPHTTPLIB_SERVER_MIN_RATE_GRACE_SECOND);
+  Server &
+  set_min_drain_rate(size_t bytes_per_sec,
+                     time_t grace_sec = CPPHTTPLIB_SERVER_MIN_RATE_GRACE_SECOND);
+  size_t slow_request_count() const;
+  size_t slow_drain_count() const;
+
+  // Serves HTTP/2 on connections that open with its client preface rather
+  // than a request line: cleartext h2c with prior knowledge (RFC 9113 3.3).
+  Server &set_h2c_prior_knowledge(bool on);
+  size_t http2_connection_count() const;
+  size_t http2_stream_count() const;
+
   bool bind_to_port(const std::string &host, int port, int socket_flags = 0);
   int bind_to_any_port(const std::string &host, int socket_flags = 0);
   bool listen_after_bind();
@@ -1037,13 +1733,31 @@ public:
   std::function<TaskQueue *(void)> new_task_queue;
 
 protected:
-  bool process_request(Stream &strm, const std::string &remote_addr,
-                       int remote_port, const std::string &local_addr,
-                       int local_port, bool close_connection,
-                       bool &connection_closed,
+  // Storage one connection recycles across its keep-alive requests. Cleared
+  // strings and header arrays keep their capacity, so after the first request
+  // parsing and response framing mostly reuse memory instead of allocating.
+  struct RequestArena {
+    std::string head;
+    Request req;
+    Response res;
+
+    void reset();
+  };
+
+  bool process_request(Stream &strm, RequestArena &arena,
+                       const std::string &remote_addr, int remote_port,
+                       const std::string &local_addr, int local_port,
+                       bool close_connection, bool &connection_closed,
                        const std::function<void(Request &)> &setup_request);
 
+  // Runs an HTTP/2 connection to its end, after `preface_read` bytes of the
+  // client preface. A TLS server enters here with 0 once ALPN selects "h2".
+  bool process_http2(Stream &strm, const std::string &remote_addr,
+                     int remote_port, const std::string &local_addr,
+                     int local_port, size_t preface_read);
+
   std::atomic<socket_t> svr_sock_{INVALID_SOCKET};
+  std::unique_ptr<detail::TimerWheel> timer_wheel_;
   size_t keep_alive_max_count_ = CPPHTTPLIB_KEEPALIVE_MAX_COUNT;
   time_t keep_alive_timeout_sec_ = CPPHTTPLIB_KEEPALIVE_TIMEOUT_SECOND;
   time_t read_timeout_sec_ = CPPHTTPLIB_SERVER_READ_TIMEOUT_SECOND;
@@ -1053,16 +1767,20 @@ protected:
   time_t idle_interval_sec_ = CPPHTTPLIB_IDLE_INTERVAL_SECOND;
   time_t idle_interval_usec_ = CPPHTTPLIB_IDLE_INTERVAL_USECOND;
   size_t payload_max_length_ = CPPHTTPLIB_PAYLOAD_MAX_LENGTH;
+  std::atomic<size_t> slow_request_count_{0};
+  std::atomic<size_t> slow_drain_count_{0};
+  detail::MinRate min_request_rate_{0, CPPHTTPLIB_SERVER_MIN_RATE_GRACE_SECOND,
+                                    &slow_request_count_};
+  detail::MinRate min_drain_rate_{0, CPPHTTPLIB_SERVER_MIN_RATE_GRACE_SECOND,
+                                  &slow_drain_count_};
+  bool h2c_prior_knowledge_ = false;
+  std::atomic<size_t> http2_connection_count_{0};
+  std::atomic<size_t> http2_stream_count_{0};
 
 private:
-  using Handlers =
-      std::vector<std::pair<std::unique_ptr<detail::MatcherBase>, Handler>>;
+  using Handlers = detail::RouteTable<Handler>;
   using HandlersForContentReader =
-      std::vector<std::pair<std::unique_ptr<detail::MatcherBase>,
-                            HandlerWithContentReader>>;
-
-  static std::unique_ptr<detail::MatcherBase>
-  make_matcher(const std::string &pattern);
+      detail::RouteTable<HandlerWithContentReader>;
 
   Server &set_error_handler_core(HandlerWithResponse handler, std::true_type);
   Server &set_error_handler_core(Handler handler, std::false_type);
@@ -1074,6 +1792,7 @@ private:
   bool listen_internal();
 
   bool routing(Request &req, Response &res, Stream &strm);
+  bool handle_request(Stream &strm, Request &req, Response &res);
   bool handle_file_request(const Request &req, Response &res,
                            bool head = false);
   bool dispatch_request(Request &req, Response &res,
@@ -1083,8 +1802,14 @@ private:
       const HandlersForContentReader &handlers) const;
 
   bool parse_request_line(const char *s, Request &req) const;
+  bool parse_request_head(const std::string &head, Request &req) const;
+  bool parse_request_target(Request &req) const;
+  void split_request_target(Request &req) const;
   void apply_ranges(const Request &req, Response &res,
                     std::string &content_type, std::string &boundary) const;
+  void prepare_response(const Request &req, Response &res,
+                        bool need_apply_ranges, std::string &content_type,
+                        std::string &boundary);
   bool write_response(Stream &strm, bool close_connection, Request &req,
                       Response &res);
   bool write_response_with_content(Stream &strm, bool close_connection,
@@ -1095,6 +1820,8 @@ private:
   bool write_content_with_provider(Stream &strm, const Request &req,
                                    Response &res, const std::string &boundary,
                                    const std::string &content_type);
+  void respond_http2(Request &req, Response &res, Stream &body,
+                     std::vector<detail::http2::BodyPiece> &pieces);
   bool read_content(Stream &strm, Request &req, Response &res);
   bool
   read_content_with_content_receiver(Stream &strm, Request &req, Response &res,
@@ -2103,6 +2830,40 @@ inline bool set_socket_opt(socket_t sock, int level, int optname, int optval) {
   return set_socket_opt_impl(sock, level, optname, &optval, sizeof(optval));
 }
 
+inline size_t get_send_buffer_size(socket_t sock) {
+  int size = 0;
+  socklen_t len = sizeof(size);
+  if (getsockopt(sock, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<char *>(&size),
+                 &len) != 0 ||
+      size <= 0) {
+    return CPPHTTPLIB_SEND_BUFSIZ;
+  }
+#ifdef __linux__
+  // Linux reports twice the payload capacity to cover bookkeeping overhead
+  size /= 2;
+#endif
+  return (std::min)(static_cast<size_t>(size), CPPHTTPLIB_SEND_BUFSIZ_MAX);
+}
+
+inline bool set_tcp_cork(socket_t sock, bool on) {
+#ifdef TCP_CORK
+  return set_socket_opt(sock, IPPROTO_TCP, TCP_CORK, on ? 1 : 0);
+#else
+  (void)(sock);
+  (void)(on);
+  return false;
+#endif
+}
+
+// Makes close() reset the connection instead of sending what is still
+// queued, so none of it goes out once the socket is closed.
+inline bool set_socket_abort_on_close(socket_t sock) {
+  struct linger l;
+  l.l_onoff = 1;
+  l.l_linger = 0;
+  return set_socket_opt_impl(sock, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+}
+
 inline bool set_socket_opt_time(socket_t sock, int level, int optname,
                                 time_t sec, time_t usec) {
 #ifdef _WIN32
@@ -2446,6 +3207,8 @@ EncodingType encoding_type(const Request &req, const Response &res);
 class BufferStream final : public Stream {
 public:
   BufferStream() = default;
+  // Writes into `buffer`'s storage, discarding its contents.
+  explicit BufferStream(std::string &&buffer);
   ~BufferStream() override = default;
 
   bool is_readable() const override;
@@ -2458,26 +3221,59 @@ public:
   time_t duration() const override;
 
   const std::string &get_buffer() const;
+  std::string release_buffer();
 
 private:
   std::string buffer;
   size_t position = 0;
 };
 
-class compressor {
-public:
-  virtual ~compressor() = default;
-
-  typedef std::function<bool(const char *data, size_t data_len)> Callback;
-  virtual bool compress(const char *data, size_t data_length, bool last,
-                        Callback callback) = 0;
-};
-
-class decompressor {
+// Holds a serialized response head and sends it together with the first body
+// write, so the head and the start of the body leave in one syscall.
+class CoalescingStream final : public Stream {
 public:
-  virtual ~decompressor() = default;
+  CoalescingStream(Stream &strm, const std::string &head)
+      : strm_(strm), head_(head) {}
+  ~CoalescingStream() override = default;
 
-  virtual bool is_valid() const = 0;
+  bool is_readable() const override;
+  bool is_writable() const override;
+  ssize_t read(char *ptr, size_t size) override;
+  ssize_t write(const char *ptr, size_t size) override;
+  bool can_write_file() const override;
+  ssize_t write_file(int fd, size_t offset, size_t size) override;
+  bool can_write_zerocopy() const override;
+  ssize_t write_zerocopy(const char *ptr, size_t size) override;
+  uint32_t zerocopy_issued() const override;
+  bool wait_zerocopy(uint32_t count) override;
+  void get_remote_ip_and_port(std::string &ip, int &port) const override;
+  void get_local_ip_and_port(std::string &ip, int &port) const override;
+  socket_t socket() const override;
+  time_t duration() const override;
+
+  // Writes whatever is left of the head when no body write picked it up.
+  bool flush();
+
+private:
+  Stream &strm_;
+  const std::string &head_;
+  size_t head_off_ = 0;
+};
+
+class compressor {
+public:
+  virtual ~compressor() = default;
+
+  typedef std::function<bool(const char *data, size_t data_len)> Callback;
+  virtual bool compress(const char *data, size_t data_length, bool last,
+                        Callback callback) = 0;
+};
+
+class decompressor {
+public:
+  virtual ~decompressor() = default;
+
+  virtual bool is_valid() const = 0;
 
   typedef std::function<bool(const char *data, size_t data_len)> Callback;
   virtual bool decompress(const char *data, size_t data_length,
@@ -2596,6 +3392,180 @@ private:
   bool is_open_empty_file = false;
 };
 
+// HTTP/2 (RFC 9113) for the server side of a connection: framing, HPACK
+// header compression (RFC 7541) and flow control. One thread runs a
+// connection and interleaves the bodies of its streams.
+namespace http2 {
+
+enum class FrameType : uint8_t {
+  Data = 0x0,
+  Headers = 0x1,
+  Priority = 0x2,
+  RstStream = 0x3,
+  Settings = 0x4,
+  PushPromise = 0x5,
+  Ping = 0x6,
+  Goaway = 0x7,
+  WindowUpdate = 0x8,
+  Continuation = 0x9,
+};
+
+enum class ErrorCode : uint32_t {
+  NoError = 0x0,
+  ProtocolError = 0x1,
+  InternalError = 0x2,
+  FlowControlError = 0x3,
+  StreamClosed = 0x5,
+  FrameSizeError = 0x6,
+  RefusedStream = 0x7,
+  Cancel = 0x8,
+  CompressionError = 0x9,
+  EnhanceYourCalm = 0xb,
+};
+
+const char connection_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const size_t connection_preface_size = sizeof(connection_preface) - 1;
+
+using HeaderFields = std::vector<std::pair<std::string, std::string>>;
+
+bool huffman_decode(const uint8_t *data, size_t len, std::string &out);
+
+// The static table followed by a dynamic table of recent fields, newest
+// first, evicted oldest first to stay within `max_size` (RFC 7541 4).
+class HpackTable {
+public:
+  size_t max_size() const { return max_size_; }
+  void set_max_size(size_t max_size);
+
+  bool get(uint64_t index, std::string &name, std::string &value) const;
+  // Index of the field, or else of a field with its name; 0 if neither.
+  uint64_t find(const std::string &name, const std::string &value,
+                bool &exact) const;
+  void insert(const std::string &name, const std::string &value);
+
+private:
+  void evict(size_t max_size);
+
+  std::deque<std::pair<std::string, std::string>> entries_;
+  size_t size_ = 0;
+  size_t max_size_ = 4096;
+};
+
+class HpackDecoder {
+public:
+  // Decoded header lists larger than `max_list_size` are refused: a small
+  // block can name large table entries many times over.
+  explicit HpackDecoder(size_t max_list_size) : max_list_size_(max_list_size) {}
+
+  // Decodes one header block into `fields`, in order. False on a
+  // compression error, which ends the connection.
+  bool decode(const uint8_t *data, size_t len, HeaderFields &fields);
+
+private:
+  HpackTable table_;
+  size_t max_list_size_;
+};
+
+// Sends repeated fields as indexes into the dynamic table, so the headers of
+// many responses for the same file cost a few bytes each. Strings go out
+// without Huffman coding.
+class HpackEncoder {
+public:
+  // Follows the peer's SETTINGS_HEADER_TABLE_SIZE.
+  void set_max_size(size_t max_size);
+
+  // Starts a header block.
+  void encode_status(int status, std::string &out);
+  // `name` must be lowercase.
+  void encode(const std::string &name, const std::string &value,
+              std::string &out);
+
+private:
+  HpackTable table_;
+  bool size_update_ = false;
+};
+
+// One piece of a response body: literal bytes, or a range of the
+// response's content provider. A provided piece of length npos lasts until
+// the provider calls done().
+struct BodyPiece {
+  std::string text;
+  bool provided = false;
+  size_t offset = 0;
+  size_t length = 0;
+};
+
+struct SessionHandler {
+  // Routes a request whose method, target, version and headers are set,
+  // filling in the response and the pieces of its body. `body` reads the
+  // request content.
+  std::function<void(Request &req, Response &res, Stream &body,
+                     std::vector<BodyPiece> &pieces)>
+      respond;
+  // Runs once the response is sent or its stream was reset.
+  std::function<void(const Request &req, Response &res)> finished;
+};
+
+class Session {
+public:
+  Session(Stream &strm, SessionHandler handler,
+          const std::atomic<socket_t> &svr_sock, time_t keep_alive_timeout_sec,
+          size_t payload_max_length);
+
+  // Runs the connection until either side ends it. The first
+  // `preface_read` bytes of the client connection preface have already been
+  // consumed, as when a request line announced HTTP/2.0.
+  bool run(size_t preface_read);
+
+private:
+  struct StreamState;
+
+  bool read_preface(size_t preface_read);
+  bool fill(bool block);
+  bool process_frames();
+  bool process_frame(FrameType type, uint8_t flags, uint32_t stream_id,
+                     const uint8_t *payload, size_t len);
+  bool end_headers(uint32_t stream_id, bool end_stream);
+  void end_request(StreamState &s);
+  void send_data(StreamState &s);
+  bool pull_body(StreamState &s, size_t want);
+  void close_stream(uint32_t stream_id, bool success);
+  void reset_stream(uint32_t stream_id, ErrorCode code);
+  void goaway(ErrorCode code);
+  bool connection_error(ErrorCode code);
+  void window_update(uint32_t stream_id, size_t increment);
+  void frame(FrameType type, uint8_t flags, uint32_t stream_id,
+             const char *payload, size_t len);
+  bool flush();
+  bool sendable(const StreamState &s) const;
+
+  Stream &strm_;
+  SessionHandler handler_;
+  const std::atomic<socket_t> &svr_sock_;
+  time_t keep_alive_timeout_sec_;
+  size_t payload_max_length_;
+
+  HpackDecoder decoder_;
+  HpackEncoder encoder_;
+  std::string in_;
+  size_t in_off_ = 0;
+  std::string out_;
+  std::map<uint32_t, std::unique_ptr<StreamState>> streams_;
+  uint32_t last_stream_id_ = 0;
+
+  // A header block continues in CONTINUATION frames until END_HEADERS.
+  uint32_t header_stream_ = 0;
+  bool header_end_stream_ = false;
+  std::string header_block_;
+
+  int64_t send_window_ = 65535;
+  int64_t initial_send_window_ = 65535;
+  size_t peer_max_frame_size_ = 16384;
+  bool goaway_received_ = false;
+};
+
+} // namespace http2
+
 // NOTE: https://www.rfc-editor.org/rfc/rfc9110#section-5
 namespace fields {
 
@@ -2999,6 +3969,157 @@ inline void split(const char *b, const char *e, char d, size_t m,
   }
 }
 
+/*
+ * Request head parser
+ *
+ * A request head is read in one piece (Stream::read_head) and parsed in
+ * place: tokens are views into the buffer, and the only per-byte work is
+ * finding the next delimiter or control character, which is vectorized.
+ */
+
+// A view into a request head buffer.
+struct HeadToken {
+  const char *data = nullptr;
+  size_t size = 0;
+};
+
+struct RequestHead {
+  HeadToken method;
+  HeadToken target;
+  HeadToken version;
+  std::array<std::pair<HeadToken, HeadToken>, CPPHTTPLIB_HEADER_MAX_COUNT>
+      fields;
+  size_t field_count = 0;
+};
+
+inline bool is_head_ctl(char c) {
+  auto u = static_cast<unsigned char>(c);
+  return (u < 0x20 && u != '\t') || u == 0x7f;
+}
+
+// Returns the first byte in [p, end) that is `stop` or a control character
+// other than HTAB, or `end`. CR and LF are control characters, so a scan
+// never runs past the end of a line.
+inline const char *scan_head_scalar(const char *p, const char *end,
+                                    char stop) {
+  while (p < end && *p != stop && !is_head_ctl(*p)) {
+    p++;
+  }
+  return p;
+}
+
+#ifdef CPPHTTPLIB_X86_SIMD
+__attribute__((target("sse4.2"))) inline const char *
+scan_head_sse42(const char *p, const char *end, char stop) {
+  // Byte ranges for PCMPESTRI: the controls around HTAB, DEL and `stop`.
+  alignas(16) char ranges[16] = {'\x00', '\x08', '\x0a', '\x1f',
+                                 '\x7f', '\x7f', stop,   stop};
+  const auto set = _mm_load_si128(reinterpret_cast<const __m128i *>(ranges));
+  while (end - p >= 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    auto i = _mm_cmpestri(set, 8, v, 16,
+                          _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                              _SIDD_LEAST_SIGNIFICANT);
+    if (i != 16) { return p + i; }
+    p += 16;
+  }
+  return scan_head_scalar(p, end, stop);
+}
+
+__attribute__((target("avx2"))) inline const char *
+scan_head_avx2(const char *p, const char *end, char stop) {
+  const auto ctl_max = _mm256_set1_epi8(0x1f);
+  const auto tab = _mm256_set1_epi8('\t');
+  const auto del = _mm256_set1_epi8(0x7f);
+  const auto stop_v = _mm256_set1_epi8(stop);
+  while (end - p >= 32) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    auto ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctl_max), v);
+    ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), ctl);
+    auto hit = _mm256_or_si256(
+        ctl, _mm256_or_si256(_mm256_cmpeq_epi8(v, del),
+                             _mm256_cmpeq_epi8(v, stop_v)));
+    auto mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+    if (mask) { return p + __builtin_ctz(mask); }
+    p += 32;
+  }
+  return scan_head_scalar(p, end, stop);
+}
+#endif
+
+using scan_head_fn = const char *(*)(const char *, const char *, char);
+
+// Picks the widest implementation the CPU supports, once.
+inline scan_head_fn scan_head_impl() {
+  static const scan_head_fn fn = [] {
+#ifdef CPPHTTPLIB_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { return &scan_head_avx2; }
+    if (__builtin_cpu_supports("sse4.2")) { return &scan_head_sse42; }
+#endif
+    return &scan_head_scalar;
+  }();
+  return fn;
+}
+
+// Parses "method SP target SP version CRLF *(field CRLF) CRLF" spanning
+// exactly [beg, end). Field values are trimmed of surrounding whitespace and
+// may not contain control characters other than HTAB.
+inline bool parse_request_head(const char *beg, const char *end,
+                               RequestHead &head, scan_head_fn scan) {
+  auto p = beg;
+
+  auto skip_spaces = [&] {
+    while (p < end && *p == ' ') {
+      p++;
+    }
+  };
+  auto line_end = [&](const char *q) {
+    return end - q >= 2 && q[0] == '\r' && q[1] == '\n';
+  };
+
+  HeadToken *request_line[] = {&head.method, &head.target, &head.version};
+  for (auto token : request_line) {
+    skip_spaces();
+    auto q = scan(p, end, ' ');
+    if (q == p) { return false; }
+    *token = HeadToken{p, static_cast<size_t>(q - p)};
+    p = q;
+  }
+  skip_spaces();
+  if (!line_end(p)) { return false; }
+  p += 2;
+
+  head.field_count = 0;
+  while (!line_end(p)) {
+    auto colon = scan(p, end, ':');
+    if (colon == p || colon == end || *colon != ':') { return false; }
+    if (head.field_count == head.fields.size()) { return false; }
+
+    auto v = colon + 1;
+    while (v < end && is_space_or_tab(*v)) {
+      v++;
+    }
+    auto v_end = scan(v, end, '\r');
+    if (!line_end(v_end)) { return false; }
+    auto e = v_end;
+    while (e > v && is_space_or_tab(e[-1])) {
+      e--;
+    }
+
+    head.fields[head.field_count++] = {
+        HeadToken{p, static_cast<size_t>(colon - p)},
+        HeadToken{v, static_cast<size_t>(e - v)}};
+    p = v_end + 2;
+  }
+  return p + 2 == end;
+}
+
+inline bool parse_request_head(const char *beg, const char *end,
+                               RequestHead &head) {
+  return parse_request_head(beg, end, head, scan_head_impl());
+}
+
 inline stream_line_reader::stream_line_reader(Stream &strm, char *fixed_buffer,
                                               size_t fixed_buffer_size)
     : strm_(strm), fixed_buffer_(fixed_buffer),
@@ -3246,6 +4367,210 @@ inline ssize_t send_socket(socket_t sock, const void *ptr, size_t size,
   });
 }
 
+#ifndef _WIN32
+inline ssize_t send_socket_gather(socket_t sock, const void *ptr1, size_t size1,
+                                  const void *ptr2, size_t size2, int flags) {
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<void *>(ptr1);
+  iov[0].iov_len = size1;
+  iov[1].iov_base = const_cast<void *>(ptr2);
+  iov[1].iov_len = size2;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+
+  return handle_EINTR([&]() { return sendmsg(sock, &msg, flags); });
+}
+#endif
+
+#ifdef CPPHTTPLIB_SPLICE
+// The pipe a thread moves file pages through on their way to a socket. Each
+// thread keeps one for all its transfers; a transfer that fails with pages
+// still in the pipe drops it, and the next one opens a fresh pipe.
+class SplicePipe {
+public:
+  static SplicePipe &get() {
+    static thread_local SplicePipe pipe;
+    return pipe;
+  }
+
+  ~SplicePipe() { reset(); }
+
+  bool open() {
+    if (fds_[0] >= 0) { return true; }
+    if (pipe2(fds_, O_CLOEXEC) != 0) {
+      fds_[0] = fds_[1] = -1;
+      return false;
+    }
+    // A larger pipe moves more per round trip; the default is 64 KB.
+    auto n = fcntl(fds_[1], F_SETPIPE_SZ, static_cast<int>(CPPHTTPLIB_SEND_BUFSIZ_MAX));
+    capacity_ = n > 0 ? static_cast<size_t>(n) : 65536;
+    return true;
+  }
+
+  void reset() {
+    if (fds_[0] >= 0) {
+      close(fds_[0]);
+      close(fds_[1]);
+    }
+    fds_[0] = fds_[1] = -1;
+  }
+
+  int read_end() const { return fds_[0]; }
+  int write_end() const { return fds_[1]; }
+  size_t capacity() const { return capacity_; }
+
+private:
+  SplicePipe() = default;
+
+  int fds_[2] = {-1, -1};
+  size_t capacity_ = 0;
+};
+
+// Moves `size` bytes of `fd` from `offset` to `sock` through the thread's
+// pipe, a pipe-full at a time. Returns the bytes sent, or -1 if nothing was.
+inline ssize_t splice_file(socket_t sock, int fd, size_t offset, size_t size) {
+  auto &pipe = SplicePipe::get();
+  if (!pipe.open()) { return -1; }
+
+  size_t sent = 0;
+  while (sent < size) {
+    auto off = static_cast<loff_t>(offset + sent);
+    auto in = handle_EINTR([&]() {
+      return splice(fd, &off, pipe.write_end(), nullptr,
+                    (std::min)(size - sent, pipe.capacity()),
+                    SPLICE_F_MOVE | SPLICE_F_MORE);
+    });
+    if (in <= 0) { break; }
+
+    auto pending = static_cast<size_t>(in);
+    while (pending > 0) {
+      auto out = handle_EINTR([&]() {
+        return splice(pipe.read_end(), nullptr, sock, nullptr, pending,
+                      SPLICE_F_MOVE | SPLICE_F_MORE);
+      });
+      if (out <= 0) {
+        pipe.reset();
+        return sent > 0 ? static_cast<ssize_t>(sent) : -1;
+      }
+      pending -= static_cast<size_t>(out);
+      sent += static_cast<size_t>(out);
+    }
+  }
+  return sent > 0 ? static_cast<ssize_t>(sent) : -1;
+}
+#endif
+
+// Process-wide MSG_ZEROCOPY accounting.
+struct ZeroCopyCounters {
+  std::atomic<uint64_t> sends{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> completions{0};
+  // Completed sends the kernel copied after all, e.g. over loopback.
+  std::atomic<uint64_t> copied{0};
+};
+
+inline ZeroCopyCounters &zerocopy_counters() {
+  static ZeroCopyCounters counters;
+  return counters;
+}
+
+#ifdef CPPHTTPLIB_ZEROCOPY
+// MSG_ZEROCOPY sends on one socket. The kernel counts send calls and reports
+// ranges of finished ones on the socket's error queue; until a send is
+// reported, the kernel still reads the caller's pages.
+class ZeroCopyState {
+public:
+  // Sets SO_ZEROCOPY once; false where the socket does not support it.
+  bool enable(socket_t sock) {
+    if (!tried_) {
+      tried_ = true;
+      int one = 1;
+      enabled_ = setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &one,
+                            sizeof(one)) == 0;
+    }
+    return enabled_;
+  }
+
+  ssize_t send(socket_t sock, const char *ptr, size_t size, int flags) {
+    auto n = send_socket(sock, ptr, size, flags | MSG_ZEROCOPY);
+    if (n >= 0) {
+      issued_++;
+      zerocopy_counters().sends++;
+      zerocopy_counters().bytes += static_cast<uint64_t>(n);
+    }
+    return n;
+  }
+
+  // Collects finished sends without blocking; true if any were reported.
+  bool reap(socket_t sock) {
+    auto reaped = false;
+    char control[128];
+    for (;;) {
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) { break; }
+
+      for (auto cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+            !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+          continue;
+        }
+        struct sock_extended_err ee;
+        memcpy(&ee, CMSG_DATA(cm), sizeof(ee));
+        if (ee.ee_errno != 0 || ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+          continue;
+        }
+        // Inclusive range of send numbers; TCP reports them in order.
+        auto n = ee.ee_data - ee.ee_info + 1;
+        completed_ += n;
+        zerocopy_counters().completions += n;
+        if (ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+          zerocopy_counters().copied += n;
+        }
+        reaped = true;
+      }
+    }
+    return reaped;
+  }
+
+  // Waits until the first `count` sends have finished, for at most the
+  // given time between notifications.
+  bool wait(socket_t sock, uint32_t count, time_t sec, time_t usec) {
+    for (;;) {
+      reap(sock);
+      if (completed_ >= count) { return true; }
+
+      // The error queue raises POLLERR whatever the requested events.
+      struct pollfd pfd;
+      pfd.fd = sock;
+      pfd.events = 0;
+      pfd.revents = 0;
+      auto timeout = static_cast<int>(sec * 1000 + usec / 1000);
+      auto ret = handle_EINTR([&]() { return poll(&pfd, 1, timeout); });
+      if (ret <= 0) { return false; }
+      if (!reap(sock) && (pfd.revents & (POLLHUP | POLLNVAL))) {
+        return completed_ >= count;
+      }
+    }
+  }
+
+  bool active() const { return enabled_; }
+  uint32_t issued() const { return issued_; }
+
+private:
+  bool tried_ = false;
+  bool enabled_ = false;
+  uint32_t issued_ = 0;
+  uint32_t completed_ = 0;
+};
+#endif
+
+// A negative `sec` waits without a timeout.
 template <bool Read>
 inline ssize_t select_impl(socket_t sock, time_t sec, time_t usec) {
 #ifdef CPPHTTPLIB_USE_POLL
@@ -3253,7 +4578,7 @@ inline ssize_t select_impl(socket_t sock, time_t sec, time_t usec) {
   pfd.fd = sock;
   pfd.events = (Read ? POLLIN : POLLOUT);
 
-  auto timeout = static_cast<int>(sec * 1000 + usec / 1000);
+  auto timeout = sec < 0 ? -1 : static_cast<int>(sec * 1000 + usec / 1000);
 
   return handle_EINTR([&]() { return poll(&pfd, 1, timeout); });
 #else
@@ -3272,7 +4597,8 @@ inline ssize_t select_impl(socket_t sock, time_t sec, time_t usec) {
   tv.tv_usec = static_cast<decltype(tv.tv_usec)>(usec);
 
   return handle_EINTR([&]() {
-    return select(static_cast<int>(sock + 1), rfds, wfds, nullptr, &tv);
+    return select(static_cast<int>(sock + 1), rfds, wfds, nullptr,
+                  sec < 0 ? nullptr : &tv);
   });
 #endif
 }
@@ -3342,7 +4668,44 @@ inline Error wait_until_socket_is_ready(socket_t sock, time_t sec,
 #endif
 }
 
+#ifdef POLLRDHUP
+// Waits for send buffer space like select_write, but also reports a peer that
+// has reset the connection, so an abandoned download is noticed before the
+// next chunk is read from disk. A client abandoning a download with data
+// still unread resets the connection at once; one that had read everything
+// resets it when the next segment reaches it.
+//
+// POLLRDHUP alone is no hang-up while a response is being written: a client
+// may shut down its sending side once its requests are out, pipelined or
+// not, and still read every response. A reset or a failed send tells when
+// it has really gone.
+inline ssize_t poll_write_or_hangup(socket_t sock, time_t sec, time_t usec) {
+  struct pollfd pfd;
+  pfd.fd = sock;
+  pfd.events = POLLOUT;
+  pfd.revents = 0;
+
+  auto timeout = sec < 0 ? -1 : static_cast<int>(sec * 1000 + usec / 1000);
+
+  auto ret = handle_EINTR([&]() { return poll(&pfd, 1, timeout); });
+  if (ret > 0 && (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))) {
+    return -1;
+  }
+  return ret;
+}
+#endif
+
 inline bool is_socket_alive(socket_t sock) {
+#ifdef POLLRDHUP
+  struct pollfd pfd;
+  pfd.fd = sock;
+  pfd.events = POLLIN | POLLRDHUP;
+  pfd.revents = 0;
+
+  auto ret = handle_EINTR([&]() { return poll(&pfd, 1, 0); });
+  if (ret < 0) { return false; }
+  return !(pfd.revents & (POLLRDHUP | POLLHUP | POLLERR | POLLNVAL));
+#else
   const auto val = detail::select_read(sock, 0, 0);
   if (val == 0) {
     return true;
@@ -3351,90 +4714,591 @@ inline bool is_socket_alive(socket_t sock) {
   }
   char buf[1];
   return detail::read_socket(sock, &buf[0], sizeof(buf), MSG_PEEK) > 0;
+#endif
 }
 
-class SocketStream final : public Stream {
+// A clock cheap enough to read several times per request, for timing the
+// stages of serving one. Counts TSC cycles where the CPU reports the TSC
+// invariant (a constant rate that keeps running in sleep states, so it is
+// monotonic and agrees across cores); a read is one instruction, with no
+// system call or vDSO page behind it. Elsewhere it counts steady_clock
+// nanoseconds. Ticks are comparable only with other ticks of this process.
+class TickClock {
 public:
-  SocketStream(socket_t sock, time_t read_timeout_sec, time_t read_timeout_usec,
-               time_t write_timeout_sec, time_t write_timeout_usec,
-               time_t max_timeout_msec = 0,
-               std::chrono::time_point<std::chrono::steady_clock> start_time =
-                   (std::chrono::steady_clock::time_point::min)());
-  ~SocketStream() override;
+  static uint64_t now() {
+#ifdef CPPHTTPLIB_TSC
+    if (tsc()) { return __rdtsc(); }
+#endif
+    return steady_ns();
+  }
 
-  bool is_readable() const override;
-  bool is_writable() const override;
-  ssize_t read(char *ptr, size_t size) override;
-  ssize_t write(const char *ptr, size_t size) override;
-  void get_remote_ip_and_port(std::string &ip, int &port) const override;
-  void get_local_ip_and_port(std::string &ip, int &port) const override;
-  socket_t socket() const override;
-  time_t duration() const override;
+  static bool tsc() {
+#ifdef CPPHTTPLIB_TSC
+    static const bool invariant = [] {
+      unsigned int eax, ebx, ecx, edx;
+      return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) &&
+             (edx & (1u << 8));
+    }();
+    return invariant;
+#else
+    return false;
+#endif
+  }
+
+  // The first tick this process read, where nanosecond timelines start.
+  static uint64_t origin() { return calibration().ticks; }
+
+  // Measured against steady_clock over the time since the first reading,
+  // so it sharpens as the process runs; waits out the first 10ms if asked
+  // sooner.
+  static double ns_per_tick() {
+    if (!tsc()) { return 1.0; }
+    const auto &start = calibration();
+    auto ns = steady_ns() - start.ns;
+    if (ns < 10000000) {
+      std::this_thread::sleep_for(std::chrono::nanoseconds(10000000 - ns));
+      ns = steady_ns() - start.ns;
+    }
+    return static_cast<double>(ns) / static_cast<double>(now() - start.ticks);
+  }
 
 private:
-  socket_t sock_;
-  time_t read_timeout_sec_;
-  time_t read_timeout_usec_;
-  time_t write_timeout_sec_;
-  time_t write_timeout_usec_;
-  time_t max_timeout_msec_;
-  const std::chrono::time_point<std::chrono::steady_clock> start_time;
+  struct Calibration {
+    uint64_t ticks;
+    uint64_t ns;
+  };
 
-  std::vector<char> read_buff_;
-  size_t read_buff_off_ = 0;
-  size_t read_buff_content_size_ = 0;
+  static const Calibration &calibration() {
+    static const Calibration start{now(), steady_ns()};
+    return start;
+  }
 
-  static const size_t read_buff_size_ = 1024l * 4;
+  static uint64_t steady_ns() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
 };
 
-#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
-class SSLSocketStream final : public Stream {
+// Ticks the connection now being served waited in the task queue after it
+// was accepted, until its first request takes them. Set by the worker
+// thread that dequeued it.
+inline uint64_t &connection_queue_ticks() {
+  static thread_local uint64_t ticks = 0;
+  return ticks;
+}
+
+inline uint64_t take_connection_queue_ticks() {
+  auto ticks = connection_queue_ticks();
+  connection_queue_ticks() = 0;
+  return ticks;
+}
+
+// Formats `t` as an HTTP date (RFC 9110 5.6.7), "Sun, 06 Nov 1994 08:49:37
+// GMT", into `buf`, which takes http_date_length bytes. Computes the
+// calendar date directly (Hinnant's civil_from_days) instead of going
+// through gmtime_r() and strftime(), which consult the locale and timezone.
+const size_t http_date_length = 29;
+
+inline void format_http_date(time_t t, char *buf) {
+  static const char weekdays[] = "SunMonTueWedThuFriSat";
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+  auto secs = static_cast<int64_t>(t);
+  auto days = secs / 86400 - (secs % 86400 < 0 ? 1 : 0);
+  auto rem = static_cast<int>(secs - days * 86400);
+  auto weekday = static_cast<int>((days % 7 + 11) % 7); // 1970-01-01: Thu
+
+  days += 719468;
+  auto era = (days >= 0 ? days : days - 146096) / 146097;
+  auto doe = days - era * 146097;
+  auto yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  auto doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  auto mp = (5 * doy + 2) / 153;
+  auto day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+  auto month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+  auto year = static_cast<int>(yoe + era * 400 + (month <= 2 ? 1 : 0));
+  year = (std::min)((std::max)(year, 0), 9999);
+
+  auto two = [](char *p, int v) {
+    p[0] = static_cast<char>('0' + v / 10);
+    p[1] = static_cast<char>('0' + v % 10);
+  };
+  memcpy(buf, weekdays + weekday * 3, 3);
+  buf[3] = ',';
+  buf[4] = ' ';
+  two(buf + 5, day);
+  buf[7] = ' ';
+  memcpy(buf + 8, months + (month - 1) * 3, 3);
+  buf[11] = ' ';
+  two(buf + 12, year / 100);
+  two(buf + 14, year % 100);
+  buf[16] = ' ';
+  two(buf + 17, rem / 3600);
+  buf[19] = ':';
+  two(buf + 20, rem / 60 % 60);
+  buf[22] = ':';
+  two(buf + 23, rem % 60);
+  memcpy(buf + 25, " GMT", 4);
+}
+
+inline std::string format_http_date(time_t t) {
+  char buf[http_date_length];
+  format_http_date(t, buf);
+  return std::string(buf, sizeof(buf));
+}
+
+// The current time as an HTTP date, reformatted once a second by its own
+// thread so responses only copy it. Readers take no lock: the text sits in
+// atomic words behind a sequence count that is odd while the thread writes
+// them, and a reader that saw it change retries.
+class DateClock {
 public:
-  SSLSocketStream(
-      socket_t sock, SSL *ssl, time_t read_timeout_sec,
-      time_t read_timeout_usec, time_t write_timeout_sec,
-      time_t write_timeout_usec, time_t max_timeout_msec = 0,
-      std::chrono::time_point<std::chrono::steady_clock> start_time =
-          (std::chrono::steady_clock::time_point::min)());
-  ~SSLSocketStream() override;
+  DateClock() {
+    update();
+    thread_ = std::thread([this] { run(); });
+  }
 
-  bool is_readable() const override;
-  bool is_writable() const override;
-  ssize_t read(char *ptr, size_t size) override;
-  ssize_t write(const char *ptr, size_t size) override;
-  void get_remote_ip_and_port(std::string &ip, int &port) const override;
-  void get_local_ip_and_port(std::string &ip, int &port) const override;
-  socket_t socket() const override;
-  time_t duration() const override;
+  ~DateClock() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_one();
+    thread_.join();
+  }
 
-private:
-  socket_t sock_;
-  SSL *ssl_;
-  time_t read_timeout_sec_;
-  time_t read_timeout_usec_;
-  time_t write_timeout_sec_;
-  time_t write_timeout_usec_;
-  time_t max_timeout_msec_;
-  const std::chrono::time_point<std::chrono::steady_clock> start_time;
-};
-#endif
+  DateClock(const DateClock &) = delete;
+  DateClock &operator=(const DateClock &) = delete;
 
-inline bool keep_alive(const std::atomic<socket_t> &svr_sock, socket_t sock,
-                       time_t keep_alive_timeout_sec) {
-  using namespace std::chrono;
+  // Copies http_date_length bytes into `buf`.
+  void read(char *buf) const {
+    uint64_t words[word_count];
+    for (;;) {
+      auto seq = seq_.load(std::memory_order_acquire);
+      if (seq & 1) { continue; }
+      for (size_t i = 0; i < word_count; i++) {
+        words[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq_.load(std::memory_order_relaxed) == seq) { break; }
+    }
+    memcpy(buf, words, http_date_length);
+  }
 
-  const auto interval_usec =
-      CPPHTTPLIB_KEEPALIVE_TIMEOUT_CHECK_INTERVAL_USECOND;
+  std::string now() const {
+    char buf[http_date_length];
+    read(buf);
+    return std::string(buf, sizeof(buf));
+  }
 
-  // Avoid expensive `steady_clock::now()` call for the first time
-  if (select_read(sock, 0, interval_usec) > 0) { return true; }
+private:
+  static const size_t word_count = 4;
 
-  const auto start = steady_clock::now() - microseconds{interval_usec};
-  const auto timeout = seconds{keep_alive_timeout_sec};
+  void update() {
+    uint64_t words[word_count] = {};
+    // Not time(), which reads the coarse clock and can still return the
+    // last second just after the thread wakes for the next.
+    auto now = std::chrono::system_clock::to_time_t(
+        std::chrono::system_clock::now());
+    format_http_date(now, reinterpret_cast<char *>(words));
 
-  while (true) {
-    if (svr_sock == INVALID_SOCKET) {
-      break; // Server socket is closed
+    auto seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < word_count; i++) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  // Wakes just after each second turns over.
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+      auto next = std::chrono::time_point_cast<std::chrono::seconds>(
+                      std::chrono::system_clock::now()) +
+                  std::chrono::seconds(1);
+      cond_.wait_until(lock, next);
+      if (!stop_) { update(); }
+    }
+  }
+
+  std::atomic<uint32_t> seq_{0};
+  std::atomic<uint64_t> words_[word_count] = {};
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+inline const DateClock &date_clock() {
+  static DateClock clock;
+  return clock;
+}
+
+inline int shutdown_socket(socket_t sock);
+
+// Server connection deadlines, kept in a hashed hierarchical timer wheel
+// (Varghese & Lauck) served by one thread. Connection threads wait in
+// poll()/select() without a timeout and the wheel shuts the socket down when
+// the deadline passes, so idle keep-alive connections cost no wakeups and
+// arming or cancelling a deadline is O(1). Pushing an armed deadline later,
+// which every read and write does, is a single atomic store: the wheel finds
+// the new value when the old slot comes due and refiles the timer.
+class TimerWheel {
+public:
+  static constexpr int64_t never = (std::numeric_limits<int64_t>::max)();
+
+  class Timer {
+  public:
+    Timer(TimerWheel &wheel, socket_t sock) : wheel_(wheel), sock_(sock) {}
+    ~Timer() { wheel_.remove(*this); }
+
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+    void arm(time_t sec, time_t usec) { wheel_.arm(*this, sec, usec); }
+    void disarm() { expires_ = never; }
+
+    // True once the wheel has shut the socket down.
+    bool fired() const { return fired_; }
+
+  private:
+    friend class TimerWheel;
+
+    TimerWheel &wheel_;
+    socket_t sock_;
+    std::atomic<int64_t> expires_{never};
+    std::atomic<int64_t> filed_at_{never}; // `never` while unlinked
+    std::atomic<bool> fired_{false};
+    Timer *prev_ = nullptr;
+    Timer *next_ = nullptr;
+    Timer **slot_ = nullptr;
+  };
+
+  TimerWheel() : epoch_(std::chrono::steady_clock::now()) {}
+
+  ~TimerWheel() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_one();
+    if (thread_.joinable()) { thread_.join(); }
+  }
+
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  // Fires every armed timer, for server shutdown.
+  void expire_all() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto &slot : slots_) {
+      for (auto t = slot; t; t = t->next_) {
+        if (t->expires_ != never) { fire(*t); }
+      }
+    }
+  }
+
+private:
+  static constexpr int slot_bits = 6;
+  static constexpr int64_t slot_count = 1 << slot_bits;
+  static constexpr int levels = 4;
+
+  int64_t now_tick() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - epoch_)
+               .count() /
+           CPPHTTPLIB_TIMER_WHEEL_TICK_MSECOND;
+  }
+
+  void arm(Timer &t, time_t sec, time_t usec) {
+    auto msec = static_cast<int64_t>(sec) * 1000 + usec / 1000;
+    auto ticks = (msec + CPPHTTPLIB_TIMER_WHEEL_TICK_MSECOND - 1) /
+                 CPPHTTPLIB_TIMER_WHEEL_TICK_MSECOND;
+    auto expires = now_tick() + (std::max)(ticks, int64_t(1));
+    t.expires_ = expires;
+
+    // The wheel unlinks a disarmed timer by clearing filed_at_ and then
+    // re-reading expires_, so either it sees this store or we see `never`.
+    if (expires < t.filed_at_) {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (t.filed_at_ != never) { unlink(t); }
+      if (count_ == 0) { current_ = now_tick(); }
+      link(t, t.expires_);
+    }
+  }
+
+  void remove(Timer &t) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    t.expires_ = never;
+    if (t.filed_at_ != never) { unlink(t); }
+  }
+
+  Timer *&slot_for(int64_t tick) {
+    auto delta = tick - current_;
+    int level = 0;
+    while (level < levels - 1 &&
+           delta >= (int64_t(1) << (slot_bits * (level + 1)))) {
+      level++;
+    }
+    auto max_delta = (int64_t(1) << (slot_bits * levels)) - 1;
+    if (delta > max_delta) { tick = current_ + max_delta; }
+    auto index = (tick >> (slot_bits * level)) & (slot_count - 1);
+    return slots_[level * slot_count + index];
+  }
+
+  void link(Timer &t, int64_t tick) {
+    if (tick <= current_) { tick = current_ + 1; }
+    auto &head = slot_for(tick);
+    t.prev_ = nullptr;
+    t.next_ = head;
+    if (head) { head->prev_ = &t; }
+    head = &t;
+    t.filed_at_ = tick;
+    t.slot_ = &head;
+    if (count_++ == 0 && !thread_.joinable()) {
+      thread_ = std::thread([this] { run(); });
+    }
+    if (tick < wakeup_) { cond_.notify_one(); }
+  }
+
+  void unlink(Timer &t) {
+    if (t.prev_) {
+      t.prev_->next_ = t.next_;
+    } else {
+      *t.slot_ = t.next_;
+    }
+    if (t.next_) { t.next_->prev_ = t.prev_; }
+    t.prev_ = t.next_ = nullptr;
+    t.filed_at_ = never;
+    count_--;
+  }
+
+  void fire(Timer &t) {
+    t.fired_ = true;
+    t.expires_ = never;
+    shutdown_socket(t.sock_);
+  }
+
+  // Moves every timer out of `head` and refiles or fires it.
+  void process(Timer *&head) {
+    auto t = head;
+    while (t) {
+      auto next = t->next_;
+      unlink(*t);
+      auto expires = t->expires_.load();
+      if (expires == never) {
+        ; // Disarmed; stays unlinked until armed again
+      } else if (expires > current_) {
+        link(*t, expires);
+      } else {
+        fire(*t);
+      }
+      t = next;
+    }
+  }
+
+  void advance() {
+    current_++;
+    for (int level = 1; level < levels; level++) {
+      auto shift = slot_bits * level;
+      if (current_ & ((int64_t(1) << shift) - 1)) { break; }
+      process(slots_[level * slot_count +
+                     ((current_ >> shift) & (slot_count - 1))]);
+    }
+    process(slots_[current_ & (slot_count - 1)]);
+  }
+
+  // Sleeps until the next occupied level-0 slot or the next cascade,
+  // whichever comes first.
+  int64_t next_wakeup() const {
+    auto boundary = (current_ | (slot_count - 1)) + 1;
+    for (auto tick = current_ + 1; tick < boundary; tick++) {
+      if (slots_[tick & (slot_count - 1)]) { return tick; }
+    }
+    return boundary;
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+      if (count_ == 0) {
+        wakeup_ = never;
+        cond_.wait(lock);
+        continue;
+      }
+      auto now = now_tick();
+      while (current_ < now && count_ > 0) {
+        advance();
+      }
+      if (count_ == 0) { continue; }
+      wakeup_ = next_wakeup();
+      cond_.wait_until(lock, epoch_ + std::chrono::milliseconds(
+                                          wakeup_ *
+                                          CPPHTTPLIB_TIMER_WHEEL_TICK_MSECOND));
+    }
+  }
+
+  const std::chrono::steady_clock::time_point epoch_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::thread thread_;
+  bool stop_ = false;
+  int64_t current_ = 0;
+  int64_t wakeup_ = never;
+  size_t count_ = 0;
+  Timer *slots_[levels * slot_count] = {};
+};
+
+class SocketStream final : public Stream {
+public:
+  SocketStream(socket_t sock, time_t read_timeout_sec, time_t read_timeout_usec,
+               time_t write_timeout_sec, time_t write_timeout_usec,
+               time_t max_timeout_msec = 0,
+               std::chrono::time_point<std::chrono::steady_clock> start_time =
+                   (std::chrono::steady_clock::time_point::min)(),
+               TimerWheel::Timer *timer = nullptr);
+  ~SocketStream() override;
+
+  bool is_readable() const override;
+  bool is_writable() const override;
+  ssize_t read(char *ptr, size_t size) override;
+  ssize_t write(const char *ptr, size_t size) override;
+  ssize_t writev(const char *ptr1, size_t size1, const char *ptr2,
+                 size_t size2) override;
+  bool read_head(std::string &head, size_t max) override;
+  bool has_buffered_input() const override;
+  bool can_write_file() const override;
+  ssize_t write_file(int fd, size_t offset, size_t size) override;
+  bool can_write_zerocopy() const override;
+  ssize_t write_zerocopy(const char *ptr, size_t size) override;
+  uint32_t zerocopy_issued() const override;
+  bool wait_zerocopy(uint32_t count) override;
+  void get_remote_ip_and_port(std::string &ip, int &port) const override;
+  void get_local_ip_and_port(std::string &ip, int &port) const override;
+  socket_t socket() const override;
+  time_t duration() const override;
+
+  // Enforced only on streams that have a timer.
+  void set_min_rates(const MinRate *read, const MinRate *write);
+
+  // Sends the writes held back for pipelined requests.
+  bool flush_writes();
+
+private:
+  bool wait_on_peer(bool read) const;
+#ifdef POLLRDHUP
+  ssize_t poll_write(time_t sec, time_t usec) const;
+#endif
+  size_t bytes_drained() const;
+
+  // A blocking send waits for a slow reader too, so its time counts toward
+  // the drain rate.
+  template <typename T> ssize_t timed_send(T send) {
+    if (!timer_ || !min_write_rate_ || !min_write_rate_->bytes_per_sec) {
+      return send();
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto n = send();
+    write_wait_usec_ += std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+    return n;
+  }
+
+  socket_t sock_;
+  time_t read_timeout_sec_;
+  time_t read_timeout_usec_;
+  time_t write_timeout_sec_;
+  time_t write_timeout_usec_;
+  time_t max_timeout_msec_;
+  const std::chrono::time_point<std::chrono::steady_clock> start_time;
+  TimerWheel::Timer *timer_;
+
+  const MinRate *min_read_rate_ = nullptr;
+  const MinRate *min_write_rate_ = nullptr;
+  size_t bytes_read_ = 0;
+  size_t bytes_written_ = 0;
+  mutable int64_t read_wait_usec_ = 0;
+  mutable int64_t write_wait_usec_ = 0;
+  mutable bool too_slow_ = false;
+#ifdef CPPHTTPLIB_ZEROCOPY
+  mutable ZeroCopyState zerocopy_;
+#endif
+
+  std::vector<char> read_buff_;
+  size_t read_buff_off_ = 0;
+  size_t read_buff_content_size_ = 0;
+
+  // While the next pipelined request is already buffered, responses queue
+  // here and leave together with the first write made once it is not.
+  std::string write_buff_;
+
+  static const size_t read_buff_size_ = 1024l * 4;
+};
+
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+class SSLSocketStream final : public Stream {
+public:
+  SSLSocketStream(
+      socket_t sock, SSL *ssl, time_t read_timeout_sec,
+      time_t read_timeout_usec, time_t write_timeout_sec,
+      time_t write_timeout_usec, time_t max_timeout_msec = 0,
+      std::chrono::time_point<std::chrono::steady_clock> start_time =
+          (std::chrono::steady_clock::time_point::min)());
+  ~SSLSocketStream() override;
+
+  bool is_readable() const override;
+  bool is_writable() const override;
+  ssize_t read(char *ptr, size_t size) override;
+  ssize_t write(const char *ptr, size_t size) override;
+  void get_remote_ip_and_port(std::string &ip, int &port) const override;
+  void get_local_ip_and_port(std::string &ip, int &port) const override;
+  socket_t socket() const override;
+  time_t duration() const override;
+
+private:
+  socket_t sock_;
+  SSL *ssl_;
+  time_t read_timeout_sec_;
+  time_t read_timeout_usec_;
+  time_t write_timeout_sec_;
+  time_t write_timeout_usec_;
+  time_t max_timeout_msec_;
+  const std::chrono::time_point<std::chrono::steady_clock> start_time;
+};
+#endif
+
+// With a timer the wait blocks until a request arrives or the wheel closes
+// the connection; without one the socket is polled at a fixed interval.
+inline bool keep_alive(const std::atomic<socket_t> &svr_sock, socket_t sock,
+                       time_t keep_alive_timeout_sec,
+                       TimerWheel::Timer *timer = nullptr) {
+  using namespace std::chrono;
+
+  if (timer) {
+    if (svr_sock == INVALID_SOCKET) { return false; }
+    timer->arm(keep_alive_timeout_sec, 0);
+    auto val = select_read(sock, -1, 0);
+    timer->disarm();
+    return val > 0 && !timer->fired() && svr_sock != INVALID_SOCKET;
+  }
+
+  const auto interval_usec =
+      CPPHTTPLIB_KEEPALIVE_TIMEOUT_CHECK_INTERVAL_USECOND;
+
+  // Avoid expensive `steady_clock::now()` call for the first time
+  if (select_read(sock, 0, interval_usec) > 0) { return true; }
+
+  const auto start = steady_clock::now() - microseconds{interval_usec};
+  const auto timeout = seconds{keep_alive_timeout_sec};
+
+  while (true) {
+    if (svr_sock == INVALID_SOCKET) {
+      break; // Server socket is closed
     }
 
     auto val = select_read(sock, 0, interval_usec);
@@ -3452,15 +5316,21 @@ inline bool keep_alive(const std::atomic<socket_t> &svr_sock, socket_t sock,
   return false;
 }
 
+// A request already buffered behind the last one, as clients that pipeline
+// send them, is served without waiting on the socket.
 template <typename T>
 inline bool
 process_server_socket_core(const std::atomic<socket_t> &svr_sock, socket_t sock,
                            size_t keep_alive_max_count,
-                           time_t keep_alive_timeout_sec, T callback) {
+                           time_t keep_alive_timeout_sec, T callback,
+                           TimerWheel::Timer *timer = nullptr,
+                           const Stream *strm = nullptr) {
   assert(keep_alive_max_count > 0);
   auto ret = false;
   auto count = keep_alive_max_count;
-  while (count > 0 && keep_alive(svr_sock, sock, keep_alive_timeout_sec)) {
+  while (count > 0 &&
+         ((strm && strm->has_buffered_input() && svr_sock != INVALID_SOCKET) ||
+          keep_alive(svr_sock, sock, keep_alive_timeout_sec, timer))) {
     auto close_connection = count == 1;
     auto connection_closed = false;
     ret = callback(close_connection, connection_closed);
@@ -3476,14 +5346,23 @@ process_server_socket(const std::atomic<socket_t> &svr_sock, socket_t sock,
                       size_t keep_alive_max_count,
                       time_t keep_alive_timeout_sec, time_t read_timeout_sec,
                       time_t read_timeout_usec, time_t write_timeout_sec,
-                      time_t write_timeout_usec, T callback) {
-  return process_server_socket_core(
+                      time_t write_timeout_usec, T callback,
+                      TimerWheel::Timer *timer = nullptr,
+                      const MinRate *min_read_rate = nullptr,
+                      const MinRate *min_write_rate = nullptr) {
+  // One stream serves the whole connection, so bytes it has read past one
+  // request are there for the next. Its min rates hold across requests.
+  SocketStream strm(sock, read_timeout_sec, read_timeout_usec,
+                    write_timeout_sec, write_timeout_usec, 0,
+                    (std::chrono::steady_clock::time_point::min)(), timer);
+  strm.set_min_rates(min_read_rate, min_write_rate);
+  auto ret = process_server_socket_core(
       svr_sock, sock, keep_alive_max_count, keep_alive_timeout_sec,
       [&](bool close_connection, bool &connection_closed) {
-        SocketStream strm(sock, read_timeout_sec, read_timeout_usec,
-                          write_timeout_sec, write_timeout_usec);
         return callback(strm, close_connection, connection_closed);
-      });
+      },
+      timer, &strm);
+  return strm.flush_writes() && ret;
 }
 
 inline bool process_client_socket(
@@ -4518,18 +6397,16 @@ inline ssize_t write_request_line(Stream &strm, const std::string &method,
 }
 
 inline ssize_t write_response_line(Stream &strm, int status) {
-  std::string s = "HTTP/1.1 ";
-  s += std::to_string(status);
-  s += " ";
-  s += httplib::status_message(status);
-  s += "\r\n";
-  return strm.write(s.data(), s.size());
+  char buf[64];
+  auto n = snprintf(buf, sizeof(buf), "HTTP/1.1 %d %s\r\n", status,
+                    httplib::status_message(status));
+  return strm.write(buf, static_cast<size_t>(n));
 }
 
 inline ssize_t write_headers(Stream &strm, const Headers &headers) {
   ssize_t write_len = 0;
+  std::string s;
   for (const auto &x : headers) {
-    std::string s;
     s = x.first;
     s += ": ";
     s += x.second;
@@ -4555,6 +6432,26 @@ inline bool write_data(Stream &strm, const char *d, size_t l) {
   return true;
 }
 
+inline bool write_file_data(Stream &strm, int fd, size_t offset, size_t l) {
+  size_t sent = 0;
+  while (sent < l) {
+    auto length = strm.write_file(fd, offset + sent, l - sent);
+    if (length < 0) { return false; }
+    sent += static_cast<size_t>(length);
+  }
+  return true;
+}
+
+inline bool write_zerocopy_data(Stream &strm, const char *d, size_t l) {
+  size_t offset = 0;
+  while (offset < l) {
+    auto length = strm.write_zerocopy(d + offset, l - offset);
+    if (length < 0) { return false; }
+    offset += static_cast<size_t>(length);
+  }
+  return true;
+}
+
 template <typename T>
 inline bool write_content(Stream &strm, const ContentProvider &content_provider,
                           size_t offset, size_t length, T is_shutting_down,
@@ -4563,9 +6460,25 @@ inline bool write_content(Stream &strm, const ContentProvider &content_provider,
   auto ok = true;
   DataSink data_sink;
 
+  // The provider may reuse its buffers once the kernel has finished sending
+  // from them. If it does not finish in time the response has failed, and
+  // the connection is reset rather than closed, so that bytes the buffers
+  // hold later are never sent on it.
+  auto released = [&]() {
+    if (strm.zerocopy_issued() == 0 ||
+        strm.wait_zerocopy(strm.zerocopy_issued())) {
+      return true;
+    }
+    set_socket_abort_on_close(strm.socket());
+    return false;
+  };
+  auto release = scope_exit([&] { released(); });
+  data_sink.preferred_write_size = get_send_buffer_size(strm.socket());
+  data_sink.socket = strm.socket();
+
   data_sink.write = [&](const char *d, size_t l) -> bool {
     if (ok) {
-      if (strm.is_writable() && write_data(strm, d, l)) {
+      if (write_data(strm, d, l)) {
         offset += l;
       } else {
         ok = false;
@@ -4574,6 +6487,36 @@ inline bool write_content(Stream &strm, const ContentProvider &content_provider,
     return ok;
   };
 
+  if (strm.can_write_file()) {
+    data_sink.write_file = [&](int fd, size_t file_offset, size_t l) -> bool {
+      if (ok) {
+        if (write_file_data(strm, fd, file_offset, l)) {
+          offset += l;
+        } else {
+          ok = false;
+        }
+      }
+      return ok;
+    };
+  }
+
+  if (strm.can_write_zerocopy()) {
+    data_sink.write_zerocopy = [&](const char *d, size_t l) -> bool {
+      if (ok) {
+        if (write_zerocopy_data(strm, d, l)) {
+          offset += l;
+        } else {
+          ok = false;
+        }
+      }
+      return ok;
+    };
+    data_sink.zerocopy_issued = [&]() { return strm.zerocopy_issued(); };
+    data_sink.zerocopy_wait = [&](uint32_t count) {
+      return strm.wait_zerocopy(count);
+    };
+  }
+
   data_sink.is_writable = [&]() -> bool { return strm.is_writable(); };
 
   while (offset < end_offset && !is_shutting_down()) {
@@ -4589,6 +6532,11 @@ inline bool write_content(Stream &strm, const ContentProvider &content_provider,
     }
   }
 
+  release.release();
+  if (!released()) {
+    error = Error::Write;
+    return false;
+  }
   error = Error::Success;
   return true;
 }
@@ -4611,11 +6559,13 @@ write_content_without_length(Stream &strm,
   auto data_available = true;
   auto ok = true;
   DataSink data_sink;
+  data_sink.preferred_write_size = get_send_buffer_size(strm.socket());
+  data_sink.socket = strm.socket();
 
   data_sink.write = [&](const char *d, size_t l) -> bool {
     if (ok) {
       offset += l;
-      if (!strm.is_writable() || !write_data(strm, d, l)) { ok = false; }
+      if (!write_data(strm, d, l)) { ok = false; }
     }
     return ok;
   };
@@ -4644,6 +6594,8 @@ write_content_chunked(Stream &strm, const ContentProvider &content_provider,
   auto data_available = true;
   auto ok = true;
   DataSink data_sink;
+  data_sink.preferred_write_size = get_send_buffer_size(strm.socket());
+  data_sink.socket = strm.socket();
 
   data_sink.write = [&](const char *d, size_t l) -> bool {
     if (ok) {
@@ -4660,10 +6612,7 @@ write_content_chunked(Stream &strm, const ContentProvider &content_provider,
           // Emit chunked response header and footer for each chunk
           auto chunk =
               from_i_to_hex(payload.size()) + "\r\n" + payload + "\r\n";
-          if (!strm.is_writable() ||
-              !write_data(strm, chunk.data(), chunk.size())) {
-            ok = false;
-          }
+          if (!write_data(strm, chunk.data(), chunk.size())) { ok = false; }
         }
       } else {
         ok = false;
@@ -4692,8 +6641,7 @@ write_content_chunked(Stream &strm, const ContentProvider &content_provider,
     if (!payload.empty()) {
       // Emit chunked response header and footer for each chunk
       auto chunk = from_i_to_hex(payload.size()) + "\r\n" + payload + "\r\n";
-      if (!strm.is_writable() ||
-          !write_data(strm, chunk.data(), chunk.size())) {
+      if (!write_data(strm, chunk.data(), chunk.size())) {
         ok = false;
         return;
       }
@@ -5949,6 +7897,16 @@ inline void Response::set_chunked_content_provider(
   is_chunked_content_provider_ = true;
 }
 
+inline void Response::set_content_provider_with_header_block(
+    size_t in_length, std::string header_block, ContentProvider provider,
+    ContentProviderResourceReleaser resource_releaser) {
+  header_block_ = std::move(header_block);
+  content_length_ = in_length;
+  if (in_length > 0) { content_provider_ = std::move(provider); }
+  content_provider_resource_releaser_ = std::move(resource_releaser);
+  is_chunked_content_provider_ = false;
+}
+
 inline void Response::set_file_content(const std::string &path,
                                        const std::string &content_type) {
   file_content_path_ = path;
@@ -5985,6 +7943,34 @@ inline ssize_t Stream::write(const std::string &s) {
   return write(s.data(), s.size());
 }
 
+inline bool Stream::read_head(std::string &head, size_t max) {
+  head.clear();
+  while (head.size() < max) {
+    char byte;
+    if (read(&byte, 1) <= 0) { return false; }
+    head += byte;
+    if (byte == '\n' && head.size() >= 4 &&
+        head.compare(head.size() - 4, 4, "\r\n\r\n") == 0) {
+      return true;
+    }
+  }
+  return true;
+}
+
+inline ssize_t Stream::writev(const char *ptr1, size_t size1, const char *ptr2,
+                              size_t size2) {
+  auto n = write(ptr1, size1);
+  if (n < static_cast<ssize_t>(size1)) { return n; }
+  auto m = write(ptr2, size2);
+  if (m < 0) { return n; }
+  return n + m;
+}
+
+inline ssize_t Stream::write_file(int /*fd*/, size_t /*offset*/,
+                                  size_t /*size*/) {
+  return -1;
+}
+
 namespace detail {
 
 inline void calc_actual_timeout(time_t max_timeout_msec,
@@ -6005,41 +7991,129 @@ inline SocketStream::SocketStream(
     socket_t sock, time_t read_timeout_sec, time_t read_timeout_usec,
     time_t write_timeout_sec, time_t write_timeout_usec,
     time_t max_timeout_msec,
-    std::chrono::time_point<std::chrono::steady_clock> start_time)
+    std::chrono::time_point<std::chrono::steady_clock> start_time,
+    TimerWheel::Timer *timer)
     : sock_(sock), read_timeout_sec_(read_timeout_sec),
       read_timeout_usec_(read_timeout_usec),
       write_timeout_sec_(write_timeout_sec),
       write_timeout_usec_(write_timeout_usec),
       max_timeout_msec_(max_timeout_msec), start_time(start_time),
-      read_buff_(read_buff_size_, 0) {}
+      timer_(timer), read_buff_(read_buff_size_, 0) {}
 
 inline SocketStream::~SocketStream() = default;
 
-inline bool SocketStream::is_readable() const {
-  if (max_timeout_msec_ <= 0) {
-    return select_read(sock_, read_timeout_sec_, read_timeout_usec_) > 0;
-  }
-
-  time_t read_timeout_sec;
-  time_t read_timeout_usec;
-  calc_actual_timeout(max_timeout_msec_, duration(), read_timeout_sec_,
-                      read_timeout_usec_, read_timeout_sec, read_timeout_usec);
-
-  return select_read(sock_, read_timeout_sec, read_timeout_usec) > 0;
+inline void SocketStream::set_min_rates(const MinRate *read,
+                                        const MinRate *write) {
+  min_read_rate_ = read;
+  min_write_rate_ = write;
 }
 
-inline bool SocketStream::is_writable() const {
-  return select_write(sock_, write_timeout_sec_, write_timeout_usec_) > 0 &&
-         is_socket_alive(sock_);
+// Bytes sent that have left the socket buffer, so a peer is not credited for
+// data that only reached the kernel.
+inline size_t SocketStream::bytes_drained() const {
+#ifdef TIOCOUTQ
+  int queued = 0;
+  if (ioctl(sock_, TIOCOUTQ, &queued) == 0 && queued > 0) {
+    return bytes_written_ - (std::min)(bytes_written_, size_t(queued));
+  }
+#endif
+  return bytes_written_;
 }
 
-inline ssize_t SocketStream::read(char *ptr, size_t size) {
-#ifdef _WIN32
-  size =
-      (std::min)(size, static_cast<size_t>((std::numeric_limits<int>::max)()));
+// Waits on the peer under the connection's timer, for at most the I/O
+// timeout or whatever is left of the peer's allowance under its min rate:
+// the grace period plus the time its bytes so far are worth, less the time
+// already spent waiting. Running out of allowance closes the connection and
+// counts it once.
+inline bool SocketStream::wait_on_peer(bool read) const {
+  auto sec = read ? read_timeout_sec_ : write_timeout_sec_;
+  auto usec = read ? read_timeout_usec_ : write_timeout_usec_;
+  auto rate = read ? min_read_rate_ : min_write_rate_;
+  auto &waited = read ? read_wait_usec_ : write_wait_usec_;
+
+  auto limited = false;
+  if (rate && rate->bytes_per_sec > 0) {
+    auto bytes = read ? bytes_read_ : bytes_drained();
+    auto allowance =
+        static_cast<int64_t>(rate->grace_sec) * 1000000 +
+        static_cast<int64_t>(bytes * 1000000.0 / rate->bytes_per_sec) - waited;
+    if (allowance < static_cast<int64_t>(sec) * 1000000 + usec) {
+      sec = static_cast<time_t>((std::max)(allowance, int64_t(0)) / 1000000);
+      usec = static_cast<time_t>((std::max)(allowance, int64_t(0)) % 1000000);
+      limited = true;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto ret = false;
+  if (!limited || sec > 0 || usec > 0) {
+    timer_->arm(sec, usec);
+#ifdef POLLRDHUP
+    ret = (read ? select_read(sock_, -1, 0) : poll_write(-1, 0)) > 0;
 #else
-  size = (std::min)(size,
-                    static_cast<size_t>((std::numeric_limits<ssize_t>::max)()));
+    ret = (read ? select_read(sock_, -1, 0) : select_write(sock_, -1, 0)) > 0 &&
+          (read || is_socket_alive(sock_));
+#endif
+    timer_->disarm();
+    waited += std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+    if (!timer_->fired()) { return ret; }
+  }
+
+  if (limited && !too_slow_ && rate->violations) {
+    too_slow_ = true;
+    (*rate->violations)++;
+  }
+  return false;
+}
+
+#ifdef POLLRDHUP
+// Finished zerocopy sends raise POLLERR too; collect them and poll again
+// rather than take them for a broken connection.
+inline ssize_t SocketStream::poll_write(time_t sec, time_t usec) const {
+  for (;;) {
+    auto ret = poll_write_or_hangup(sock_, sec, usec);
+#ifdef CPPHTTPLIB_ZEROCOPY
+    if (ret < 0 && zerocopy_.active() && zerocopy_.reap(sock_)) { continue; }
+#endif
+    return ret;
+  }
+}
+#endif
+
+inline bool SocketStream::is_readable() const {
+  if (timer_) { return wait_on_peer(true); }
+
+  if (max_timeout_msec_ <= 0) {
+    return select_read(sock_, read_timeout_sec_, read_timeout_usec_) > 0;
+  }
+
+  time_t read_timeout_sec;
+  time_t read_timeout_usec;
+  calc_actual_timeout(max_timeout_msec_, duration(), read_timeout_sec_,
+                      read_timeout_usec_, read_timeout_sec, read_timeout_usec);
+
+  return select_read(sock_, read_timeout_sec, read_timeout_usec) > 0;
+}
+
+inline bool SocketStream::is_writable() const {
+  if (timer_) { return wait_on_peer(false); }
+#ifdef POLLRDHUP
+  return poll_write(write_timeout_sec_, write_timeout_usec_) > 0;
+#else
+  return select_write(sock_, write_timeout_sec_, write_timeout_usec_) > 0 &&
+         is_socket_alive(sock_);
+#endif
+}
+
+inline ssize_t SocketStream::read(char *ptr, size_t size) {
+#ifdef _WIN32
+  size =
+      (std::min)(size, static_cast<size_t>((std::numeric_limits<int>::max)()));
+#else
+  size = (std::min)(size,
+                    static_cast<size_t>((std::numeric_limits<ssize_t>::max)()));
 #endif
 
   if (read_buff_off_ < read_buff_content_size_) {
@@ -6055,7 +8129,8 @@ inline ssize_t SocketStream::read(char *ptr, size_t size) {
     }
   }
 
-  if (!is_readable()) { return -1; }
+  // The peer may be waiting on the queued responses before it sends more.
+  if (!flush_writes() || !is_readable()) { return -1; }
 
   read_buff_off_ = 0;
   read_buff_content_size_ = 0;
@@ -6065,7 +8140,9 @@ inline ssize_t SocketStream::read(char *ptr, size_t size) {
                          CPPHTTPLIB_RECV_FLAGS);
     if (n <= 0) {
       return n;
-    } else if (n <= static_cast<ssize_t>(size)) {
+    }
+    bytes_read_ += static_cast<size_t>(n);
+    if (n <= static_cast<ssize_t>(size)) {
       memcpy(ptr, read_buff_.data(), static_cast<size_t>(n));
       return n;
     } else {
@@ -6075,11 +8152,59 @@ inline ssize_t SocketStream::read(char *ptr, size_t size) {
       return static_cast<ssize_t>(size);
     }
   } else {
-    return read_socket(sock_, ptr, size, CPPHTTPLIB_RECV_FLAGS);
+    auto n = read_socket(sock_, ptr, size, CPPHTTPLIB_RECV_FLAGS);
+    if (n > 0) { bytes_read_ += static_cast<size_t>(n); }
+    return n;
   }
 }
 
+// Copies whole receive-buffer fills into `head` and hands back whatever
+// follows the blank line, instead of reading a byte per call.
+inline bool SocketStream::read_head(std::string &head, size_t max) {
+  head.clear();
+  for (;;) {
+    if (read_buff_off_ == read_buff_content_size_) {
+      if (!flush_writes() || !is_readable()) { return false; }
+      auto n = read_socket(sock_, read_buff_.data(), read_buff_size_,
+                           CPPHTTPLIB_RECV_FLAGS);
+      if (n <= 0) { return false; }
+      bytes_read_ += static_cast<size_t>(n);
+      read_buff_off_ = 0;
+      read_buff_content_size_ = static_cast<size_t>(n);
+    }
+
+    auto scanned = head.size() < 3 ? 0 : head.size() - 3;
+    auto appended = head.size();
+    head.append(read_buff_.data() + read_buff_off_,
+                read_buff_content_size_ - read_buff_off_);
+
+    auto pos = head.find("\r\n\r\n", scanned, 4);
+    if (pos != std::string::npos) {
+      head.resize(pos + 4);
+      read_buff_off_ += head.size() - appended;
+      return true;
+    }
+    read_buff_off_ = read_buff_content_size_;
+    if (head.size() >= max) { return true; }
+  }
+}
+
+inline bool SocketStream::has_buffered_input() const {
+  return read_buff_off_ < read_buff_content_size_;
+}
+
 inline ssize_t SocketStream::write(const char *ptr, size_t size) {
+  if (has_buffered_input() || !write_buff_.empty()) {
+    if (write_buff_.size() + size <= CPPHTTPLIB_PIPELINE_BUFFER_SIZE) {
+      write_buff_.append(ptr, size);
+      if (has_buffered_input() || flush_writes()) {
+        return static_cast<ssize_t>(size);
+      }
+      return -1;
+    }
+    if (!flush_writes()) { return -1; }
+  }
+
   if (!is_writable()) { return -1; }
 
 #if defined(_WIN32) && !defined(_WIN64)
@@ -6087,7 +8212,115 @@ inline ssize_t SocketStream::write(const char *ptr, size_t size) {
       (std::min)(size, static_cast<size_t>((std::numeric_limits<int>::max)()));
 #endif
 
-  return send_socket(sock_, ptr, size, CPPHTTPLIB_SEND_FLAGS);
+  auto n = timed_send([&] {
+    return send_socket(sock_, ptr, size, CPPHTTPLIB_SEND_FLAGS);
+  });
+  if (n > 0) { bytes_written_ += static_cast<size_t>(n); }
+  return n;
+}
+
+inline ssize_t SocketStream::writev(const char *ptr1, size_t size1,
+                                    const char *ptr2, size_t size2) {
+#ifdef _WIN32
+  return Stream::writev(ptr1, size1, ptr2, size2);
+#else
+  if (has_buffered_input() || !write_buff_.empty()) {
+    // Both parts join the queue, so the head does not go out apart from
+    // its body and wait on a delayed ACK.
+    if (write_buff_.size() + size1 + size2 <= CPPHTTPLIB_PIPELINE_BUFFER_SIZE) {
+      write_buff_.append(ptr1, size1);
+      write_buff_.append(ptr2, size2);
+      if (has_buffered_input() || flush_writes()) {
+        return static_cast<ssize_t>(size1 + size2);
+      }
+      return -1;
+    }
+    if (!flush_writes()) { return -1; }
+  }
+  if (!is_writable()) { return -1; }
+
+  auto n = timed_send([&] {
+    return send_socket_gather(sock_, ptr1, size1, ptr2, size2,
+                              CPPHTTPLIB_SEND_FLAGS);
+  });
+  if (n > 0) { bytes_written_ += static_cast<size_t>(n); }
+  return n;
+#endif
+}
+
+inline bool SocketStream::flush_writes() {
+  size_t off = 0;
+  while (off < write_buff_.size() && is_writable()) {
+    auto n = timed_send([&] {
+      return send_socket(sock_, write_buff_.data() + off,
+                         write_buff_.size() - off, CPPHTTPLIB_SEND_FLAGS);
+    });
+    if (n <= 0) { break; }
+    bytes_written_ += static_cast<size_t>(n);
+    off += static_cast<size_t>(n);
+  }
+  auto ret = off == write_buff_.size();
+  write_buff_.clear();
+  return ret;
+}
+
+inline bool SocketStream::can_write_file() const {
+#ifdef CPPHTTPLIB_SPLICE
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline ssize_t SocketStream::write_file(int fd, size_t offset, size_t size) {
+#ifdef CPPHTTPLIB_SPLICE
+  if (!flush_writes() || !is_writable()) { return -1; }
+
+  auto n = timed_send([&] { return splice_file(sock_, fd, offset, size); });
+  if (n > 0) { bytes_written_ += static_cast<size_t>(n); }
+  return n;
+#else
+  return Stream::write_file(fd, offset, size);
+#endif
+}
+
+inline bool SocketStream::can_write_zerocopy() const {
+#ifdef CPPHTTPLIB_ZEROCOPY
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline ssize_t SocketStream::write_zerocopy(const char *ptr, size_t size) {
+#ifdef CPPHTTPLIB_ZEROCOPY
+  if (!zerocopy_.enable(sock_)) { return write(ptr, size); }
+  if (!flush_writes() || !is_writable()) { return -1; }
+
+  auto n = timed_send(
+      [&] { return zerocopy_.send(sock_, ptr, size, CPPHTTPLIB_SEND_FLAGS); });
+  if (n > 0) { bytes_written_ += static_cast<size_t>(n); }
+  return n;
+#else
+  return write(ptr, size);
+#endif
+}
+
+inline uint32_t SocketStream::zerocopy_issued() const {
+#ifdef CPPHTTPLIB_ZEROCOPY
+  return zerocopy_.issued();
+#else
+  return 0;
+#endif
+}
+
+inline bool SocketStream::wait_zerocopy(uint32_t count) {
+#ifdef CPPHTTPLIB_ZEROCOPY
+  return zerocopy_.wait(sock_, count, write_timeout_sec_, write_timeout_usec_);
+#else
+  (void)count;
+  return true;
+#endif
 }
 
 inline void SocketStream::get_remote_ip_and_port(std::string &ip,
@@ -6109,6 +8342,11 @@ inline time_t SocketStream::duration() const {
 }
 
 // Buffer stream implementation
+inline BufferStream::BufferStream(std::string &&buffer)
+    : buffer(std::move(buffer)) {
+  this->buffer.clear();
+}
+
 inline bool BufferStream::is_readable() const { return true; }
 
 inline bool BufferStream::is_writable() const { return true; }
@@ -6140,6 +8378,94 @@ inline time_t BufferStream::duration() const { return 0; }
 
 inline const std::string &BufferStream::get_buffer() const { return buffer; }
 
+inline std::string BufferStream::release_buffer() {
+  position = 0;
+  return std::move(buffer);
+}
+
+// Coalescing stream implementation
+inline bool CoalescingStream::is_readable() const {
+  return strm_.is_readable();
+}
+
+inline bool CoalescingStream::is_writable() const {
+  return strm_.is_writable();
+}
+
+inline ssize_t CoalescingStream::read(char *ptr, size_t size) {
+  return strm_.read(ptr, size);
+}
+
+inline ssize_t CoalescingStream::write(const char *ptr, size_t size) {
+  while (head_off_ < head_.size()) {
+    auto head_left = head_.size() - head_off_;
+    auto n = strm_.writev(head_.data() + head_off_, head_left, ptr, size);
+    if (n < 0) { return n; }
+
+    auto written = static_cast<size_t>(n);
+    if (written < head_left) {
+      head_off_ += written;
+      continue;
+    }
+    head_off_ = head_.size();
+    if (written > head_left) {
+      return static_cast<ssize_t>(written - head_left);
+    }
+  }
+  return strm_.write(ptr, size);
+}
+
+inline bool CoalescingStream::can_write_file() const {
+  return strm_.can_write_file();
+}
+
+// File pages cannot share a syscall with the head; send the head first. A
+// corked socket still packs both into full segments.
+inline ssize_t CoalescingStream::write_file(int fd, size_t offset,
+                                            size_t size) {
+  if (!flush()) { return -1; }
+  return strm_.write_file(fd, offset, size);
+}
+
+inline bool CoalescingStream::can_write_zerocopy() const {
+  return strm_.can_write_zerocopy();
+}
+
+// The head is sent by copy first, like for write_file().
+inline ssize_t CoalescingStream::write_zerocopy(const char *ptr, size_t size) {
+  if (!flush()) { return -1; }
+  return strm_.write_zerocopy(ptr, size);
+}
+
+inline uint32_t CoalescingStream::zerocopy_issued() const {
+  return strm_.zerocopy_issued();
+}
+
+inline bool CoalescingStream::wait_zerocopy(uint32_t count) {
+  return strm_.wait_zerocopy(count);
+}
+
+inline void CoalescingStream::get_remote_ip_and_port(std::string &ip,
+                                                     int &port) const {
+  strm_.get_remote_ip_and_port(ip, port);
+}
+
+inline void CoalescingStream::get_local_ip_and_port(std::string &ip,
+                                                    int &port) const {
+  strm_.get_local_ip_and_port(ip, port);
+}
+
+inline socket_t CoalescingStream::socket() const { return strm_.socket(); }
+
+inline time_t CoalescingStream::duration() const { return strm_.duration(); }
+
+inline bool CoalescingStream::flush() {
+  if (head_off_ >= head_.size()) { return true; }
+  auto ret = write_data(strm_, head_.data() + head_off_, head_.size() - head_off_);
+  head_off_ = head_.size();
+  return ret;
+}
+
 inline PathParamsMatcher::PathParamsMatcher(const std::string &pattern) {
   static constexpr char marker[] = "/:";
 
@@ -6176,72 +8502,1187 @@ inline PathParamsMatcher::PathParamsMatcher(const std::string &pattern) {
                         "' multiple times in route pattern '" + pattern + "'.";
       throw std::invalid_argument(msg);
     }
-#endif
-
-    param_names_.push_back(std::move(param_name));
-
-    last_param_end = sep_pos + 1;
+#endif
+
+    param_names_.push_back(std::move(param_name));
+
+    last_param_end = sep_pos + 1;
+  }
+
+  if (last_param_end < pattern.length()) {
+    static_fragments_.push_back(pattern.substr(last_param_end));
+  }
+}
+
+inline bool PathParamsMatcher::match(Request &request) const {
+  request.matches = std::smatch();
+  request.path_params.clear();
+  request.path_params.reserve(param_names_.size());
+
+  // One past the position at which the path matched the pattern last time
+  std::size_t starting_pos = 0;
+  for (size_t i = 0; i < static_fragments_.size(); ++i) {
+    const auto &fragment = static_fragments_[i];
+
+    if (starting_pos + fragment.length() > request.path.length()) {
+      return false;
+    }
+
+    // Avoid unnecessary allocation by using strncmp instead of substr +
+    // comparison
+    if (std::strncmp(request.path.c_str() + starting_pos, fragment.c_str(),
+                     fragment.length()) != 0) {
+      return false;
+    }
+
+    starting_pos += fragment.length();
+
+    // Should only happen when we have a static fragment after a param
+    // Example: '/users/:id/subscriptions'
+    // The 'subscriptions' fragment here does not have a corresponding param
+    if (i >= param_names_.size()) { continue; }
+
+    auto sep_pos = request.path.find(separator, starting_pos);
+    if (sep_pos == std::string::npos) { sep_pos = request.path.length(); }
+
+    const auto &param_name = param_names_[i];
+
+    request.path_params.emplace(
+        param_name, request.path.substr(starting_pos, sep_pos - starting_pos));
+
+    // Mark everything up to '/' as matched
+    starting_pos = sep_pos + 1;
+  }
+  // Returns false if the path is longer than the pattern
+  return starting_pos >= request.path.length();
+}
+
+inline bool RegexMatcher::match(Request &request) const {
+  request.path_params.clear();
+  return std::regex_match(request.path, request.matches, regex_);
+}
+
+inline void RouteTree::insert(const std::string &key, bool prefix,
+                              size_t route) {
+  auto node = &root_;
+  size_t i = 0;
+  while (i < key.size()) {
+    auto it = std::find_if(
+        node->children.begin(), node->children.end(),
+        [&](const std::unique_ptr<Node> &c) { return c->label[0] == key[i]; });
+    if (it == node->children.end()) {
+      node->children.emplace_back(new Node);
+      node = node->children.back().get();
+      node->label = key.substr(i);
+      break;
+    }
+
+    auto &child = *it;
+    size_t n = 0;
+    while (n < child->label.size() && i + n < key.size() &&
+           child->label[n] == key[i + n]) {
+      n++;
+    }
+    if (n < child->label.size()) {
+      // Split the edge where the key leaves it.
+      std::unique_ptr<Node> mid(new Node);
+      mid->label = child->label.substr(0, n);
+      child->label.erase(0, n);
+      mid->children.push_back(std::move(child));
+      child = std::move(mid);
+    }
+    node = child.get();
+    i += n;
+  }
+
+  auto &slot = prefix ? node->prefix : node->exact;
+  slot = (std::min)(slot, route);
+}
+
+inline size_t RouteTree::find(const std::string &path) const {
+  // ".*" stops at line terminators, so a prefix route only matches when
+  // none follow the prefix.
+  auto last_terminator = path.find_last_of("\r\n");
+  auto prefix_ok = [&](size_t i) {
+    return last_terminator == std::string::npos || last_terminator < i;
+  };
+
+  auto best = npos;
+  auto node = &root_;
+  size_t i = 0;
+  for (;;) {
+    if (node->prefix != npos && prefix_ok(i)) {
+      best = (std::min)(best, node->prefix);
+    }
+    if (i == path.size()) {
+      best = (std::min)(best, node->exact);
+      break;
+    }
+    auto it = std::find_if(
+        node->children.begin(), node->children.end(),
+        [&](const std::unique_ptr<Node> &c) { return c->label[0] == path[i]; });
+    if (it == node->children.end() ||
+        path.compare(i, (*it)->label.size(), (*it)->label) != 0) {
+      break;
+    }
+    i += (*it)->label.size();
+    node = it->get();
+  }
+  return best;
+}
+
+inline bool parse_literal_route(const std::string &pattern, std::string &key,
+                                bool &prefix) {
+  key.clear();
+  prefix = false;
+  for (size_t i = 0; i < pattern.size(); i++) {
+    auto c = pattern[i];
+    if (c == '\\') {
+      if (i + 1 == pattern.size() ||
+          std::isalnum(static_cast<unsigned char>(pattern[i + 1]))) {
+        return false;
+      }
+      key += pattern[++i];
+    } else if (c == '.' && i + 2 == pattern.size() && pattern[i + 1] == '*') {
+      prefix = true;
+      return true;
+    } else if (strchr("^$.|?*+()[]{}", c)) {
+      return false;
+    } else {
+      key += c;
+    }
+  }
+  return true;
+}
+
+
+// HTTP/2 implementation
+namespace http2 {
+
+inline const std::array<std::pair<const char *, const char *>, 61> &
+static_table() {
+  static const std::array<std::pair<const char *, const char *>, 61> table = {{
+      {":authority", ""},
+      {":method", "GET"},
+      {":method", "POST"},
+      {":path", "/"},
+      {":path", "/index.html"},
+      {":scheme", "http"},
+      {":scheme", "https"},
+      {":status", "200"},
+      {":status", "204"},
+      {":status", "206"},
+      {":status", "304"},
+      {":status", "400"},
+      {":status", "404"},
+      {":status", "500"},
+      {"accept-charset", ""},
+      {"accept-encoding", "gzip, deflate"},
+      {"accept-language", ""},
+      {"accept-ranges", ""},
+      {"accept", ""},
+      {"access-control-allow-origin", ""},
+      {"age", ""},
+      {"allow", ""},
+      {"authorization", ""},
+      {"cache-control", ""},
+      {"content-disposition", ""},
+      {"content-encoding", ""},
+      {"content-language", ""},
+      {"content-length", ""},
+      {"content-location", ""},
+      {"content-range", ""},
+      {"content-type", ""},
+      {"cookie", ""},
+      {"date", ""},
+      {"etag", ""},
+      {"expect", ""},
+      {"expires", ""},
+      {"from", ""},
+      {"host", ""},
+      {"if-match", ""},
+      {"if-modified-since", ""},
+      {"if-none-match", ""},
+      {"if-range", ""},
+      {"if-unmodified-since", ""},
+      {"last-modified", ""},
+      {"link", ""},
+      {"location", ""},
+      {"max-forwards", ""},
+      {"proxy-authenticate", ""},
+      {"proxy-authorization", ""},
+      {"range", ""},
+      {"referer", ""},
+      {"refresh", ""},
+      {"retry-after", ""},
+      {"server", ""},
+      {"set-cookie", ""},
+      {"strict-transport-security", ""},
+      {"transfer-encoding", ""},
+      {"user-agent", ""},
+      {"vary", ""},
+      {"via", ""},
+      {"www-authenticate", ""},
+  }};
+  return table;
+}
+
+// The canonical Huffman code of RFC 7541 Appendix B, EOS last.
+inline const std::vector<std::array<int16_t, 2>> &huffman_tree() {
+  static const uint32_t codes[257] = {
+      0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5,
+      0xfffffe6, 0xfffffe7, 0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9,
+      0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec, 0xfffffed, 0xfffffee,
+      0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+      0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9,
+      0xffffffa, 0xffffffb, 0x14, 0x3f8, 0x3f9, 0xffa,
+      0x1ff9, 0x15, 0xf8, 0x7fa, 0x3fa, 0x3fb,
+      0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+      0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b,
+      0x1c, 0x1d, 0x1e, 0x1f, 0x5c, 0xfb,
+      0x7ffc, 0x20, 0xffb, 0x3fc, 0x1ffa, 0x21,
+      0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+      0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+      0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e,
+      0x6f, 0x70, 0x71, 0x72, 0xfc, 0x73,
+      0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+      0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5,
+      0x25, 0x26, 0x27, 0x6, 0x74, 0x75,
+      0x28, 0x29, 0x2a, 0x7, 0x2b, 0x76,
+      0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+      0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd,
+      0x1ffd, 0xffffffc, 0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8,
+      0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9, 0x3fffd6, 0x7fffda,
+      0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+      0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1,
+      0x7fffe2, 0x7fffe3, 0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5,
+      0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef, 0x3fffda, 0x1fffdd,
+      0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+      0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf,
+      0x7fffeb, 0x7fffec, 0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2,
+      0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef, 0xfffea, 0x3fffe2,
+      0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+      0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2,
+      0x3fffe8, 0x1ffffec, 0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde,
+      0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed, 0x7fff2, 0x1fffe3,
+      0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+      0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3,
+      0x7ffffe4, 0x7ffffe5, 0xfffec, 0xfffff3, 0xfffed, 0x1fffe6,
+      0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3, 0x3fffea, 0x3fffeb,
+      0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+      0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8,
+      0x7ffffe9, 0x7ffffea, 0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed,
+      0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+      0x3fffffff,
+  };
+  static const uint8_t lengths[257] = {
+      13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+      28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+      6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+      5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+      13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+      15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+      6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+      20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+      24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+      22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+      21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+      26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+      19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+      20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+      26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+      30,
+  };
+
+  // Node 0 is the root; a child of 0 is missing and a negative child is the
+  // leaf for symbol -(child + 1).
+  static const std::vector<std::array<int16_t, 2>> tree = [] {
+    std::vector<std::array<int16_t, 2>> t(1, std::array<int16_t, 2>{{0, 0}});
+    for (int sym = 0; sym < 257; sym++) {
+      size_t node = 0;
+      for (int i = lengths[sym] - 1; i >= 0; i--) {
+        auto bit = (codes[sym] >> i) & 1;
+        if (i == 0) {
+          t[node][bit] = static_cast<int16_t>(-(sym + 1));
+        } else {
+          if (t[node][bit] == 0) {
+            t[node][bit] = static_cast<int16_t>(t.size());
+            t.push_back(std::array<int16_t, 2>{{0, 0}});
+          }
+          node = static_cast<size_t>(t[node][bit]);
+        }
+      }
+    }
+    return t;
+  }();
+  return tree;
+}
+
+inline bool huffman_decode(const uint8_t *data, size_t len, std::string &out) {
+  const auto &tree = huffman_tree();
+  size_t node = 0;
+  size_t bits = 0; // since the last symbol
+  auto ones = true;
+  for (size_t i = 0; i < len; i++) {
+    for (int b = 7; b >= 0; b--) {
+      auto bit = (data[i] >> b) & 1;
+      auto next = tree[node][bit];
+      bits++;
+      ones = ones && bit;
+      if (next < 0) {
+        if (next == -257) { return false; } // EOS
+        out += static_cast<char>(-next - 1);
+        node = 0;
+        bits = 0;
+        ones = true;
+      } else if (next == 0) {
+        return false;
+      } else {
+        node = static_cast<size_t>(next);
+      }
+    }
+  }
+  // Padding is a prefix of EOS, all ones, shorter than a byte.
+  return bits < 8 && ones;
+}
+
+inline bool decode_integer(const uint8_t *&p, const uint8_t *end,
+                           int prefix_bits, uint64_t &value) {
+  if (p == end) { return false; }
+  uint64_t max = (1u << prefix_bits) - 1;
+  value = *p++ & max;
+  if (value < max) { return true; }
+  for (int shift = 0; shift < 56; shift += 7) {
+    if (p == end) { return false; }
+    auto b = *p++;
+    value += static_cast<uint64_t>(b & 0x7f) << shift;
+    if (!(b & 0x80)) { return true; }
+  }
+  return false;
+}
+
+inline bool decode_string(const uint8_t *&p, const uint8_t *end,
+                          std::string &out) {
+  if (p == end) { return false; }
+  auto huffman = (*p & 0x80) != 0;
+  uint64_t len = 0;
+  if (!decode_integer(p, end, 7, len) ||
+      len > static_cast<uint64_t>(end - p)) {
+    return false;
+  }
+  out.clear();
+  if (huffman) {
+    if (!huffman_decode(p, static_cast<size_t>(len), out)) { return false; }
+  } else {
+    out.assign(reinterpret_cast<const char *>(p), static_cast<size_t>(len));
+  }
+  p += len;
+  return true;
+}
+
+inline void encode_integer(uint64_t value, int prefix_bits, uint8_t first,
+                           std::string &out) {
+  uint64_t max = (1u << prefix_bits) - 1;
+  if (value < max) {
+    out += static_cast<char>(first | value);
+    return;
+  }
+  out += static_cast<char>(first | max);
+  value -= max;
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+inline void encode_string(const std::string &s, std::string &out) {
+  encode_integer(s.size(), 7, 0, out);
+  out += s;
+}
+
+inline size_t entry_size(const std::string &name, const std::string &value) {
+  return name.size() + value.size() + 32;
+}
+
+inline void HpackTable::set_max_size(size_t max_size) {
+  max_size_ = max_size;
+  evict(max_size_);
+}
+
+inline bool HpackTable::get(uint64_t index, std::string &name,
+                            std::string &value) const {
+  const auto &st = static_table();
+  if (index == 0) { return false; }
+  if (index <= st.size()) {
+    name = st[index - 1].first;
+    value = st[index - 1].second;
+    return true;
+  }
+  index -= st.size() + 1;
+  if (index >= entries_.size()) { return false; }
+  name = entries_[index].first;
+  value = entries_[index].second;
+  return true;
+}
+
+inline uint64_t HpackTable::find(const std::string &name,
+                                 const std::string &value, bool &exact) const {
+  const auto &st = static_table();
+  uint64_t by_name = 0;
+  exact = false;
+  for (size_t i = 0; i < st.size(); i++) {
+    if (name != st[i].first) { continue; }
+    if (value == st[i].second) {
+      exact = true;
+      return i + 1;
+    }
+    if (!by_name) { by_name = i + 1; }
+  }
+  for (size_t i = 0; i < entries_.size(); i++) {
+    if (name != entries_[i].first) { continue; }
+    if (value == entries_[i].second) {
+      exact = true;
+      return st.size() + 1 + i;
+    }
+    if (!by_name) { by_name = st.size() + 1 + i; }
+  }
+  return by_name;
+}
+
+inline void HpackTable::insert(const std::string &name,
+                               const std::string &value) {
+  auto size = entry_size(name, value);
+  if (size > max_size_) {
+    evict(0);
+    return;
+  }
+  evict(max_size_ - size);
+  entries_.emplace_front(name, value);
+  size_ += size;
+}
+
+inline void HpackTable::evict(size_t max_size) {
+  while (size_ > max_size) {
+    size_ -= entry_size(entries_.back().first, entries_.back().second);
+    entries_.pop_back();
+  }
+}
+
+inline bool HpackDecoder::decode(const uint8_t *data, size_t len,
+                                 HeaderFields &fields) {
+  auto p = data;
+  auto end = data + len;
+  auto size_update_allowed = true;
+  size_t list_size = 0;
+  std::string name;
+  std::string value;
+  while (p < end) {
+    auto b = *p;
+    uint64_t index = 0;
+    if ((b & 0xe0) == 0x20) {
+      // Dynamic table size update, only before the first field and never
+      // past the 4096 bytes the default SETTINGS_HEADER_TABLE_SIZE allows.
+      if (!size_update_allowed || !decode_integer(p, end, 5, index) ||
+          index > 4096) {
+        return false;
+      }
+      table_.set_max_size(static_cast<size_t>(index));
+      continue;
+    }
+    size_update_allowed = false;
+
+    if (b & 0x80) {
+      if (!decode_integer(p, end, 7, index) ||
+          !table_.get(index, name, value)) {
+        return false;
+      }
+    } else {
+      // Literal with incremental indexing (01), without indexing (0000) or
+      // never indexed (0001).
+      auto indexing = (b & 0x40) != 0;
+      if (!decode_integer(p, end, indexing ? 6 : 4, index)) { return false; }
+      if (index == 0) {
+        if (!decode_string(p, end, name)) { return false; }
+      } else if (!table_.get(index, name, value)) {
+        return false;
+      }
+      if (!decode_string(p, end, value)) { return false; }
+      if (indexing) { table_.insert(name, value); }
+    }
+
+    list_size += entry_size(name, value);
+    if (list_size > max_list_size_) { return false; }
+    fields.emplace_back(name, value);
+  }
+  return true;
+}
+
+inline void HpackEncoder::set_max_size(size_t max_size) {
+  // The decoder may allow more; 4096 bytes hold the headers of a response.
+  max_size = (std::min)(max_size, size_t(4096));
+  if (max_size == table_.max_size()) { return; }
+  table_.set_max_size(max_size);
+  size_update_ = true;
+}
+
+inline void HpackEncoder::encode_status(int status, std::string &out) {
+  if (size_update_) {
+    encode_integer(table_.max_size(), 5, 0x20, out);
+    size_update_ = false;
+  }
+  switch (status) {
+  case 200: out += static_cast<char>(0x80 | 8); break;
+  case 204: out += static_cast<char>(0x80 | 9); break;
+  case 206: out += static_cast<char>(0x80 | 10); break;
+  case 304: out += static_cast<char>(0x80 | 11); break;
+  case 400: out += static_cast<char>(0x80 | 12); break;
+  case 404: out += static_cast<char>(0x80 | 13); break;
+  case 500: out += static_cast<char>(0x80 | 14); break;
+  default: encode(":status", std::to_string(status), out); break;
+  }
+}
+
+inline void HpackEncoder::encode(const std::string &name,
+                                 const std::string &value, std::string &out) {
+  auto exact = false;
+  auto index = table_.find(name, value, exact);
+  if (exact) {
+    encode_integer(index, 7, 0x80, out);
+    return;
+  }
+
+  // Fields that differ in every response would only push useful ones out.
+  auto indexing = name != "content-length" && name != "content-range" &&
+                  name != "date" &&
+                  entry_size(name, value) <= table_.max_size() / 4;
+  encode_integer(index, indexing ? 6 : 4, indexing ? 0x40 : 0x00, out);
+  if (index == 0) { encode_string(name, out); }
+  encode_string(value, out);
+  if (indexing) { table_.insert(name, value); }
+}
+
+const uint8_t flag_end_stream = 0x1;
+const uint8_t flag_ack = 0x1;
+const uint8_t flag_end_headers = 0x4;
+const uint8_t flag_padded = 0x8;
+const uint8_t flag_priority = 0x20;
+
+// Larger frames, beyond the default SETTINGS_MAX_FRAME_SIZE, are refused.
+const size_t max_frame_size = 16384;
+// Body bytes one stream sends before the others get their turn.
+const size_t stream_quantum = 65536;
+
+inline uint32_t read_u32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+         static_cast<uint32_t>(p[2]) << 8 | static_cast<uint32_t>(p[3]);
+}
+
+inline void write_u32(char *p, uint32_t v) {
+  p[0] = static_cast<char>(v >> 24);
+  p[1] = static_cast<char>(v >> 16);
+  p[2] = static_cast<char>(v >> 8);
+  p[3] = static_cast<char>(v);
+}
+
+inline bool strip_padding(const uint8_t *&data, size_t &len) {
+  if (len < 1 || data[0] >= len) { return false; }
+  len -= 1 + data[0];
+  data += 1;
+  return true;
+}
+
+inline bool is_connection_specific(const std::string &name) {
+  return case_ignore::equal(name, "Connection") ||
+         case_ignore::equal(name, "Keep-Alive") ||
+         case_ignore::equal(name, "Proxy-Connection") ||
+         case_ignore::equal(name, "Transfer-Encoding") ||
+         case_ignore::equal(name, "Upgrade");
+}
+
+struct Session::StreamState {
+  uint32_t id = 0;
+  Request req;
+  Response res;
+
+  // Until the request has ended; the response starts then.
+  bool receiving = true;
+  std::string body;
+  size_t body_size = 0;
+
+  int64_t send_window = 0;
+  std::vector<BodyPiece> pieces;
+  size_t piece = 0;
+  size_t piece_sent = 0;
+  std::string pending;
+  size_t pending_off = 0;
+  bool end_sent = false;
+  bool failed = false;
+};
+
+inline Session::Session(Stream &strm, SessionHandler handler,
+                        const std::atomic<socket_t> &svr_sock,
+                        time_t keep_alive_timeout_sec,
+                        size_t payload_max_length)
+    : strm_(strm), handler_(std::move(handler)), svr_sock_(svr_sock),
+      keep_alive_timeout_sec_(keep_alive_timeout_sec),
+      payload_max_length_(payload_max_length),
+      decoder_(CPPHTTPLIB_REQUEST_HEAD_MAX_LENGTH) {}
+
+inline bool Session::run(size_t preface_read) {
+  auto close_all = scope_exit([&] {
+    while (!streams_.empty()) {
+      close_stream(streams_.begin()->first, false);
+    }
+  });
+
+  // Everything at its default but the number of concurrent streams.
+  char settings[6] = {0, 0x3};
+  write_u32(settings + 2, CPPHTTPLIB_HTTP2_MAX_CONCURRENT_STREAMS);
+  frame(FrameType::Settings, 0, 0, settings, sizeof(settings));
+  if (!flush() || !read_preface(preface_read)) { return false; }
+
+  for (;;) {
+    if (!process_frames()) { return false; }
+
+    // One round: each stream that may send gets up to a quantum.
+    std::vector<uint32_t> ended;
+    for (const auto &kv : streams_) {
+      auto &s = *kv.second;
+      if (sendable(s)) { send_data(s); }
+      if (s.end_sent || s.failed) { ended.push_back(s.id); }
+    }
+    for (auto id : ended) {
+      auto failed = streams_[id]->failed;
+      if (failed) { reset_stream(id, ErrorCode::InternalError); }
+      close_stream(id, !failed);
+    }
+    if (!flush()) { return false; }
+
+    if (svr_sock_ == INVALID_SOCKET ||
+        (goaway_received_ && streams_.empty())) {
+      goaway(ErrorCode::NoError);
+      return flush();
+    }
+
+    auto busy = false;
+    for (const auto &kv : streams_) {
+      busy = busy || sendable(*kv.second);
+    }
+    if (streams_.empty() &&
+        !keep_alive(svr_sock_, strm_.socket(), keep_alive_timeout_sec_)) {
+      goaway(ErrorCode::NoError);
+      return flush();
+    }
+    if (!fill(!busy)) { return false; }
+  }
+}
+
+inline bool Session::read_preface(size_t preface_read) {
+  auto rest = connection_preface_size - preface_read;
+  while (in_.size() - in_off_ < rest) {
+    if (!fill(true)) { return false; }
+  }
+  if (in_.compare(in_off_, rest, connection_preface + preface_read) != 0) {
+    return connection_error(ErrorCode::ProtocolError);
+  }
+  in_off_ += rest;
+  return true;
+}
+
+// Reads what the peer has sent; without `block`, only if it is there
+// already. The first read drains what the stream buffered behind the request
+// line, and reads this large bypass its buffer after that, so polling the
+// socket sees everything still pending.
+inline bool Session::fill(bool block) {
+  if (!block && select_read(strm_.socket(), 0, 0) <= 0) { return true; }
+  if (in_off_ == in_.size()) {
+    in_.clear();
+    in_off_ = 0;
+  } else if (in_off_ >= CPPHTTPLIB_RECV_BUFSIZ) {
+    in_.erase(0, in_off_);
+    in_off_ = 0;
+  }
+  auto size = in_.size();
+  in_.resize(size + CPPHTTPLIB_RECV_BUFSIZ);
+  auto n = strm_.read(&in_[size], CPPHTTPLIB_RECV_BUFSIZ);
+  in_.resize(size + static_cast<size_t>((std::max)(n, ssize_t(0))));
+  return n > 0;
+}
+
+inline bool Session::process_frames() {
+  while (in_.size() - in_off_ >= 9) {
+    auto p = reinterpret_cast<const uint8_t *>(in_.data()) + in_off_;
+    size_t len = static_cast<size_t>(p[0]) << 16 |
+                 static_cast<size_t>(p[1]) << 8 | p[2];
+    if (len > max_frame_size) {
+      return connection_error(ErrorCode::FrameSizeError);
+    }
+    if (in_.size() - in_off_ < 9 + len) { break; }
+    in_off_ += 9 + len;
+    if (!process_frame(static_cast<FrameType>(p[3]), p[4],
+                       read_u32(p + 5) & 0x7fffffff, p + 9, len)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline bool Session::process_frame(FrameType type, uint8_t flags,
+                                   uint32_t stream_id, const uint8_t *payload,
+                                   size_t len) {
+  // Nothing may come between the frames of a header block.
+  if (header_stream_ && (type != FrameType::Continuation ||
+                         stream_id != header_stream_)) {
+    return connection_error(ErrorCode::ProtocolError);
+  }
+
+  switch (type) {
+  case FrameType::Data: {
+    if (stream_id == 0) { return connection_error(ErrorCode::ProtocolError); }
+    auto data = payload;
+    auto size = len;
+    if ((flags & flag_padded) && !strip_padding(data, size)) {
+      return connection_error(ErrorCode::ProtocolError);
+    }
+    // Received bytes are credited straight back, so our windows never
+    // stall the peer.
+    if (len > 0) { window_update(0, len); }
+
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end() || !it->second->receiving) {
+      if (stream_id > last_stream_id_) {
+        return connection_error(ErrorCode::ProtocolError);
+      }
+      reset_stream(stream_id, ErrorCode::StreamClosed);
+      return true;
+    }
+    auto &s = *it->second;
+    s.body_size += size;
+    if (size <= payload_max_length_ - s.body.size()) {
+      s.body.append(reinterpret_cast<const char *>(data), size);
+    }
+    if (flags & flag_end_stream) {
+      end_request(s);
+    } else if (len > 0) {
+      window_update(stream_id, len);
+    }
+    return true;
+  }
+  case FrameType::Headers: {
+    if (stream_id == 0 || !(stream_id & 1)) {
+      return connection_error(ErrorCode::ProtocolError);
+    }
+    auto data = payload;
+    auto size = len;
+    if ((flags & flag_padded) && !strip_padding(data, size)) {
+      return connection_error(ErrorCode::ProtocolError);
+    }
+    if (flags & flag_priority) {
+      if (size < 5) { return connection_error(ErrorCode::FrameSizeError); }
+      data += 5;
+      size -= 5;
+    }
+    header_block_.assign(reinterpret_cast<const char *>(data), size);
+    header_end_stream_ = (flags & flag_end_stream) != 0;
+    if (flags & flag_end_headers) {
+      return end_headers(stream_id, header_end_stream_);
+    }
+    header_stream_ = stream_id;
+    return true;
+  }
+  case FrameType::Continuation: {
+    if (!header_stream_) { return connection_error(ErrorCode::ProtocolError); }
+    header_block_.append(reinterpret_cast<const char *>(payload), len);
+    if (header_block_.size() > CPPHTTPLIB_REQUEST_HEAD_MAX_LENGTH) {
+      return connection_error(ErrorCode::EnhanceYourCalm);
+    }
+    if (flags & flag_end_headers) {
+      return end_headers(stream_id, header_end_stream_);
+    }
+    return true;
+  }
+  case FrameType::Priority:
+    if (stream_id == 0) { return connection_error(ErrorCode::ProtocolError); }
+    if (len != 5) { reset_stream(stream_id, ErrorCode::FrameSizeError); }
+    return true;
+  case FrameType::RstStream:
+    if (stream_id == 0 || stream_id > last_stream_id_) {
+      return connection_error(ErrorCode::ProtocolError);
+    }
+    if (len != 4) { return connection_error(ErrorCode::FrameSizeError); }
+    close_stream(stream_id, false);
+    return true;
+  case FrameType::Settings:
+    if (stream_id != 0) { return connection_error(ErrorCode::ProtocolError); }
+    if (flags & flag_ack) {
+      return len == 0 || connection_error(ErrorCode::FrameSizeError);
+    }
+    if (len % 6) { return connection_error(ErrorCode::FrameSizeError); }
+    for (size_t i = 0; i < len; i += 6) {
+      auto value = read_u32(payload + i + 2);
+      switch (payload[i] << 8 | payload[i + 1]) {
+      case 0x1: encoder_.set_max_size(value); break;
+      case 0x2:
+        if (value > 1) { return connection_error(ErrorCode::ProtocolError); }
+        break;
+      case 0x4:
+        if (value > 0x7fffffff) {
+          return connection_error(ErrorCode::FlowControlError);
+        }
+        // A window the change pushes past the maximum is a connection
+        // error (RFC 9113 6.9.2).
+        for (const auto &kv : streams_) {
+          kv.second->send_window += static_cast<int64_t>(value) -
+                                    initial_send_window_;
+          if (kv.second->send_window > 0x7fffffff) {
+            return connection_error(ErrorCode::FlowControlError);
+          }
+        }
+        initial_send_window_ = value;
+        break;
+      case 0x5:
+        if (value < 16384 || value > 16777215) {
+          return connection_error(ErrorCode::ProtocolError);
+        }
+        peer_max_frame_size_ = value;
+        break;
+      default: break;
+      }
+    }
+    frame(FrameType::Settings, flag_ack, 0, nullptr, 0);
+    return true;
+  case FrameType::PushPromise:
+    return connection_error(ErrorCode::ProtocolError);
+  case FrameType::Ping:
+    if (stream_id != 0) { return connection_error(ErrorCode::ProtocolError); }
+    if (len != 8) { return connection_error(ErrorCode::FrameSizeError); }
+    if (!(flags & flag_ack)) {
+      frame(FrameType::Ping, flag_ack, 0,
+            reinterpret_cast<const char *>(payload), len);
+    }
+    return true;
+  case FrameType::Goaway:
+    if (stream_id != 0) { return connection_error(ErrorCode::ProtocolError); }
+    goaway_received_ = true;
+    return true;
+  case FrameType::WindowUpdate: {
+    if (len != 4) { return connection_error(ErrorCode::FrameSizeError); }
+    auto increment = read_u32(payload) & 0x7fffffff;
+    if (stream_id == 0) {
+      send_window_ += increment;
+      if (increment == 0) {
+        return connection_error(ErrorCode::ProtocolError);
+      }
+      if (send_window_ > 0x7fffffff) {
+        return connection_error(ErrorCode::FlowControlError);
+      }
+      return true;
+    }
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end()) { return true; }
+    auto &s = *it->second;
+    s.send_window += increment;
+    if (increment == 0 || s.send_window > 0x7fffffff) {
+      reset_stream(stream_id, increment == 0 ? ErrorCode::ProtocolError
+                                             : ErrorCode::FlowControlError);
+      close_stream(stream_id, false);
+    }
+    return true;
+  }
+  default: return true; // Unknown frame types are ignored.
+  }
+}
+
+inline bool Session::end_headers(uint32_t stream_id, bool end_stream) {
+  auto head_ticks = TickClock::now();
+  header_stream_ = 0;
+  HeaderFields fields;
+  if (!decoder_.decode(reinterpret_cast<const uint8_t *>(header_block_.data()),
+                       header_block_.size(), fields)) {
+    return connection_error(ErrorCode::CompressionError);
+  }
+
+  auto it = streams_.find(stream_id);
+  if (it != streams_.end()) {
+    // Trailers end the request and are otherwise ignored.
+    auto &s = *it->second;
+    if (s.receiving && end_stream) {
+      end_request(s);
+    } else {
+      reset_stream(stream_id, ErrorCode::ProtocolError);
+      close_stream(stream_id, false);
+    }
+    return true;
+  }
+  if (stream_id <= last_stream_id_) {
+    return connection_error(ErrorCode::ProtocolError);
+  }
+  last_stream_id_ = stream_id;
+  if (streams_.size() >= CPPHTTPLIB_HTTP2_MAX_CONCURRENT_STREAMS) {
+    reset_stream(stream_id, ErrorCode::RefusedStream);
+    return true;
+  }
+
+  auto s = detail::make_unique<StreamState>();
+  s->id = stream_id;
+  s->send_window = initial_send_window_;
+  auto &req = s->req;
+  std::string authority;
+  std::string cookie;
+  auto malformed = false;
+  for (const auto &field : fields) {
+    const auto &name = field.first;
+    if (!name.empty() && name[0] == ':') {
+      if (name == ":method") {
+        req.method = field.second;
+      } else if (name == ":path") {
+        req.target = field.second;
+      } else if (name == ":authority") {
+        authority = field.second;
+      } else if (name != ":scheme") {
+        malformed = true;
+      }
+    } else if (name == "cookie") {
+      // Cookies may arrive split into several fields (RFC 9113 8.2.3).
+      if (!cookie.empty()) { cookie += "; "; }
+      cookie += field.second;
+    } else if (is_connection_specific(name)) {
+      malformed = true;
+    } else {
+      req.headers.emplace(name, field.second);
+    }
+  }
+  if (malformed || req.method.empty() || req.target.empty()) {
+    reset_stream(stream_id, ErrorCode::ProtocolError);
+    return true;
+  }
+  if (!cookie.empty()) { req.headers.emplace("cookie", cookie); }
+  if (!authority.empty() && !req.has_header("Host")) {
+    req.headers.emplace("Host", authority);
+  }
+  req.version = "HTTP/2";
+  req.head_ticks_ = head_ticks;
+
+  auto &state = *s;
+  streams_.emplace(stream_id, std::move(s));
+  if (end_stream) { end_request(state); }
+  return true;
+}
+
+// Hands the finished request to the server and sends the response headers;
+// the body follows in send_data().
+inline void Session::end_request(StreamState &s) {
+  s.receiving = false;
+  // Routing reads the body by its length, which HTTP/2 need not send. A
+  // body over the limit was not kept; its size lets routing refuse it.
+  if (s.body_size > payload_max_length_ ||
+      (s.body_size > 0 && !s.req.has_header("Content-Length"))) {
+    s.req.set_header("Content-Length", std::to_string(s.body_size));
+  }
+  BufferStream body;
+  body.write(s.body.data(), s.body.size());
+  std::string().swap(s.body);
+  handler_.respond(s.req, s.res, body, s.pieces);
+
+  std::string block;
+  std::string name;
+  encoder_.encode_status(s.res.status, block);
+  auto add = [&](const std::string &key, const std::string &value) {
+    if (is_connection_specific(key)) { return; }
+    name = key;
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    encoder_.encode(name, value, block);
+  };
+  for (const auto &h : s.res.headers) {
+    add(h.first, h.second);
+  }
+  const auto &lines = s.res.header_block_;
+  for (size_t pos = 0; pos < lines.size();) {
+    auto eol = lines.find("\r\n", pos);
+    if (eol == std::string::npos) { break; }
+    auto colon = lines.find(':', pos);
+    if (colon < eol) {
+      auto value = lines.find_first_not_of(' ', colon + 1);
+      add(lines.substr(pos, colon - pos),
+          value < eol ? lines.substr(value, eol - value) : std::string());
+    }
+    pos = eol + 2;
+  }
+
+  auto end_stream = s.pieces.empty();
+  auto type = FrameType::Headers;
+  size_t off = 0;
+  do {
+    auto n = (std::min)(block.size() - off, peer_max_frame_size_);
+    uint8_t flags = 0;
+    if (type == FrameType::Headers && end_stream) { flags |= flag_end_stream; }
+    if (off + n == block.size()) { flags |= flag_end_headers; }
+    frame(type, flags, s.id, block.data() + off, n);
+    off += n;
+    type = FrameType::Continuation;
+  } while (off < block.size());
+  s.end_sent = end_stream;
+}
+
+inline bool Session::sendable(const StreamState &s) const {
+  if (s.receiving || s.end_sent || s.failed) { return false; }
+  // An ended body still owes the END_STREAM flag, which takes no window.
+  if (s.piece == s.pieces.size() && s.pending_off == s.pending.size()) {
+    return true;
+  }
+  return s.send_window > 0 && send_window_ > 0;
+}
+
+// Sends up to a quantum of the stream's body, within both flow control
+// windows and the peer's frame size.
+inline void Session::send_data(StreamState &s) {
+  auto budget = (std::min)((std::min)(s.send_window, send_window_),
+                           static_cast<int64_t>(stream_quantum));
+  while (budget > 0) {
+    if (s.pending_off == s.pending.size()) {
+      if (s.piece == s.pieces.size()) { break; }
+      auto piece = s.piece;
+      if (!pull_body(s, static_cast<size_t>(budget))) {
+        s.failed = true;
+        return;
+      }
+      // A provider may have nothing yet, as when it is pacing.
+      if (s.pending.empty()) {
+        if (s.piece == piece) { break; }
+        continue;
+      }
+    }
+    auto n = (std::min)((std::min)(s.pending.size() - s.pending_off,
+                                   static_cast<size_t>(budget)),
+                        peer_max_frame_size_);
+    auto last = s.pending_off + n == s.pending.size() &&
+                s.piece == s.pieces.size();
+    frame(FrameType::Data, last ? flag_end_stream : 0, s.id,
+          s.pending.data() + s.pending_off, n);
+    s.pending_off += n;
+    s.send_window -= static_cast<int64_t>(n);
+    send_window_ -= static_cast<int64_t>(n);
+    budget -= static_cast<int64_t>(n);
+    if (last) {
+      s.end_sent = true;
+      return;
+    }
   }
-
-  if (last_param_end < pattern.length()) {
-    static_fragments_.push_back(pattern.substr(last_param_end));
+  if (s.piece == s.pieces.size() && s.pending_off == s.pending.size()) {
+    frame(FrameType::Data, flag_end_stream, s.id, nullptr, 0);
+    s.end_sent = true;
   }
 }
 
-inline bool PathParamsMatcher::match(Request &request) const {
-  request.matches = std::smatch();
-  request.path_params.clear();
-  request.path_params.reserve(param_names_.size());
-
-  // One past the position at which the path matched the pattern last time
-  std::size_t starting_pos = 0;
-  for (size_t i = 0; i < static_fragments_.size(); ++i) {
-    const auto &fragment = static_fragments_[i];
-
-    if (starting_pos + fragment.length() > request.path.length()) {
-      return false;
-    }
+// Fetches the next bytes of the body into `pending`: the rest of a literal
+// piece, or up to `want` bytes from the content provider.
+inline bool Session::pull_body(StreamState &s, size_t want) {
+  s.pending.clear();
+  s.pending_off = 0;
+  auto &piece = s.pieces[s.piece];
+  if (!piece.provided) {
+    s.pending.swap(piece.text);
+    s.piece++;
+    return true;
+  }
 
-    // Avoid unnecessary allocation by using strncmp instead of substr +
-    // comparison
-    if (std::strncmp(request.path.c_str() + starting_pos, fragment.c_str(),
-                     fragment.length()) != 0) {
-      return false;
-    }
+  auto done = false;
+  DataSink sink;
+  sink.preferred_write_size = want;
+  // sink.socket stays unset: options set on the socket, such as a pacing
+  // rate, would apply to every stream of the connection.
+  sink.write = [&](const char *d, size_t l) {
+    s.pending.append(d, l);
+    return true;
+  };
+  sink.is_writable = [&]() { return is_socket_alive(strm_.socket()); };
+  sink.done = [&]() { done = true; };
+  // Trailers are not sent.
+  sink.done_with_trailer = [&](const Headers &) { done = true; };
+
+  auto offset = piece.offset + s.piece_sent;
+  if (piece.length == std::string::npos) {
+    if (!s.res.content_provider_(offset, 0, sink)) { return false; }
+  } else {
+    auto length = (std::min)(piece.length - s.piece_sent, want);
+    if (!s.res.content_provider_(offset, length, sink)) { return false; }
+  }
+  s.piece_sent += s.pending.size();
+  if (done || (piece.length != std::string::npos &&
+               s.piece_sent >= piece.length)) {
+    s.piece++;
+    s.piece_sent = 0;
+  }
+  return true;
+}
 
-    starting_pos += fragment.length();
+// Forgets the stream; one that got as far as a response is reported to
+// the handler.
+inline void Session::close_stream(uint32_t stream_id, bool success) {
+  auto it = streams_.find(stream_id);
+  if (it == streams_.end()) { return; }
+  auto s = std::move(it->second);
+  streams_.erase(it);
+  if (s->receiving) { return; }
+  if (success && s->res.content_provider_) {
+    s->res.content_provider_success_ = true;
+  }
+  if (handler_.finished) { handler_.finished(s->req, s->res); }
+}
 
-    // Should only happen when we have a static fragment after a param
-    // Example: '/users/:id/subscriptions'
-    // The 'subscriptions' fragment here does not have a corresponding param
-    if (i >= param_names_.size()) { continue; }
+inline void Session::reset_stream(uint32_t stream_id, ErrorCode code) {
+  char payload[4];
+  write_u32(payload, static_cast<uint32_t>(code));
+  frame(FrameType::RstStream, 0, stream_id, payload, sizeof(payload));
+}
 
-    auto sep_pos = request.path.find(separator, starting_pos);
-    if (sep_pos == std::string::npos) { sep_pos = request.path.length(); }
+inline void Session::goaway(ErrorCode code) {
+  char payload[8];
+  write_u32(payload, last_stream_id_);
+  write_u32(payload + 4, static_cast<uint32_t>(code));
+  frame(FrameType::Goaway, 0, 0, payload, sizeof(payload));
+}
 
-    const auto &param_name = param_names_[i];
+inline bool Session::connection_error(ErrorCode code) {
+  goaway(code);
+  flush();
+  return false;
+}
 
-    request.path_params.emplace(
-        param_name, request.path.substr(starting_pos, sep_pos - starting_pos));
+inline void Session::window_update(uint32_t stream_id, size_t increment) {
+  char payload[4];
+  write_u32(payload, static_cast<uint32_t>(increment));
+  frame(FrameType::WindowUpdate, 0, stream_id, payload, sizeof(payload));
+}
 
-    // Mark everything up to '/' as matched
-    starting_pos = sep_pos + 1;
-  }
-  // Returns false if the path is longer than the pattern
-  return starting_pos >= request.path.length();
+inline void Session::frame(FrameType type, uint8_t flags, uint32_t stream_id,
+                           const char *payload, size_t len) {
+  char head[9] = {static_cast<char>(len >> 16), static_cast<char>(len >> 8),
+                  static_cast<char>(len), static_cast<char>(type),
+                  static_cast<char>(flags)};
+  write_u32(head + 5, stream_id);
+  out_.append(head, sizeof(head));
+  if (len > 0) { out_.append(payload, len); }
 }
 
-inline bool RegexMatcher::match(Request &request) const {
-  request.path_params.clear();
-  return std::regex_match(request.path, request.matches, regex_);
+inline bool Session::flush() {
+  if (out_.empty()) { return true; }
+  auto ok = write_data(strm_, out_.data(), out_.size());
+  out_.clear();
+  return ok;
 }
 
+} // namespace http2
+
 } // namespace detail
 
 // HTTP server implementation
 inline Server::Server()
     : new_task_queue(
-          [] { return new ThreadPool(CPPHTTPLIB_THREAD_POOL_COUNT); }) {
+          [] { return new ThreadPool(CPPHTTPLIB_THREAD_POOL_COUNT); }),
+      timer_wheel_(new detail::TimerWheel) {
 #ifndef _WIN32
   signal(SIGPIPE, SIG_IGN);
 #endif
@@ -6249,70 +9690,57 @@ inline Server::Server()
 
 inline Server::~Server() = default;
 
-inline std::unique_ptr<detail::MatcherBase>
-Server::make_matcher(const std::string &pattern) {
-  if (pattern.find("/:") != std::string::npos) {
-    return detail::make_unique<detail::PathParamsMatcher>(pattern);
-  } else {
-    return detail::make_unique<detail::RegexMatcher>(pattern);
-  }
-}
-
 inline Server &Server::Get(const std::string &pattern, Handler handler) {
-  get_handlers_.emplace_back(make_matcher(pattern), std::move(handler));
+  get_handlers_.add(pattern, std::move(handler));
   return *this;
 }
 
 inline Server &Server::Post(const std::string &pattern, Handler handler) {
-  post_handlers_.emplace_back(make_matcher(pattern), std::move(handler));
+  post_handlers_.add(pattern, std::move(handler));
   return *this;
 }
 
 inline Server &Server::Post(const std::string &pattern,
                             HandlerWithContentReader handler) {
-  post_handlers_for_content_reader_.emplace_back(make_matcher(pattern),
-                                                 std::move(handler));
+  post_handlers_for_content_reader_.add(pattern, std::move(handler));
   return *this;
 }
 
 inline Server &Server::Put(const std::string &pattern, Handler handler) {
-  put_handlers_.emplace_back(make_matcher(pattern), std::move(handler));
+  put_handlers_.add(pattern, std::move(handler));
   return *this;
 }
 
 inline Server &Server::Put(const std::string &pattern,
                            HandlerWithContentReader handler) {
-  put_handlers_for_content_reader_.emplace_back(make_matcher(pattern),
-                                                std::move(handler));
+  put_handlers_for_content_reader_.add(pattern, std::move(handler));
   return *this;
 }
 
 inline Server &Server::Patch(const std::string &pattern, Handler handler) {
-  patch_handlers_.emplace_back(make_matcher(pattern), std::move(handler));
+  patch_handlers_.add(pattern, std::move(handler));
   return *this;
 }
 
 inline Server &Server::Patch(const std::string &pattern,
                              HandlerWithContentReader handler) {
-  patch_handlers_for_content_reader_.emplace_back(make_matcher(pattern),
-                                                  std::move(handler));
+  patch_handlers_for_content_reader_.add(pattern, std::move(handler));
   return *this;
 }
 
 inline Server &Server::Delete(const std::string &pattern, Handler handler) {
-  delete_handlers_.emplace_back(make_matcher(pattern), std::move(handler));
+  delete_handlers_.add(pattern, std::move(handler));
   return *this;
 }
 
 inline Server &Server::Delete(const std::string &pattern,
                               HandlerWithContentReader handler) {
-  delete_handlers_for_content_reader_.emplace_back(make_matcher(pattern),
-                                                   std::move(handler));
+  delete_handlers_for_content_reader_.add(pattern, std::move(handler));
   return *this;
 }
 
 inline Server &Server::Options(const std::string &pattern, Handler handler) {
-  options_handlers_.emplace_back(make_matcher(pattern), std::move(handler));
+  options_handlers_.add(pattern, std::move(handler));
   return *this;
 }
 
@@ -6466,6 +9894,39 @@ inline Server &Server::set_payload_max_length(size_t length) {
   return *this;
 }
 
+inline Server &Server::set_min_request_rate(size_t bytes_per_sec,
+                                            time_t grace_sec) {
+  min_request_rate_.bytes_per_sec = bytes_per_sec;
+  min_request_rate_.grace_sec = grace_sec;
+  return *this;
+}
+
+inline Server &Server::set_min_drain_rate(size_t bytes_per_sec,
+                                          time_t grace_sec) {
+  min_drain_rate_.bytes_per_sec = bytes_per_sec;
+  min_drain_rate_.grace_sec = grace_sec;
+  return *this;
+}
+
+inline size_t Server::slow_request_count() const {
+  return slow_request_count_;
+}
+
+inline size_t Server::slow_drain_count() const { return slow_drain_count_; }
+
+inline Server &Server::set_h2c_prior_knowledge(bool on) {
+  h2c_prior_knowledge_ = on;
+  return *this;
+}
+
+inline size_t Server::http2_connection_count() const {
+  return http2_connection_count_;
+}
+
+inline size_t Server::http2_stream_count() const {
+  return http2_stream_count_;
+}
+
 inline bool Server::bind_to_port(const std::string &host, int port,
                                  int socket_flags) {
   auto ret = bind_internal(host, port, socket_flags);
@@ -6499,6 +9960,7 @@ inline void Server::stop() {
     std::atomic<socket_t> sock(svr_sock_.exchange(INVALID_SOCKET));
     detail::shutdown_socket(sock);
     detail::close_socket(sock);
+    timer_wheel_->expire_all();
   }
   is_decommisioned = false;
 }
@@ -6526,6 +9988,36 @@ inline bool Server::parse_request_line(const char *s, Request &req) const {
     if (count != 3) { return false; }
   }
 
+  return parse_request_target(req);
+}
+
+inline bool Server::parse_request_head(const std::string &head,
+                                       Request &req) const {
+  detail::RequestHead parsed;
+  if (!detail::parse_request_head(head.data(), head.data() + head.size(),
+                                  parsed)) {
+    return false;
+  }
+
+  req.method.assign(parsed.method.data, parsed.method.size);
+  req.target.assign(parsed.target.data, parsed.target.size);
+  req.version.assign(parsed.version.data, parsed.version.size);
+
+  for (size_t i = 0; i < parsed.field_count; i++) {
+    const auto &key = parsed.fields[i].first;
+    const auto &val = parsed.fields[i].second;
+    auto it = req.headers.emplace(key.data, key.size, val.data, val.size);
+    if (memchr(val.data, '%', val.size) &&
+        !detail::case_ignore::equal(it->first, "Location") &&
+        !detail::case_ignore::equal(it->first, "Referer")) {
+      it->second = detail::decode_url(it->second, false);
+    }
+  }
+
+  return parse_request_target(req);
+}
+
+inline bool Server::parse_request_target(Request &req) const {
   static const std::set<std::string> methods{
       "GET",     "HEAD",    "POST",  "PUT",   "DELETE",
       "CONNECT", "OPTIONS", "TRACE", "PATCH", "PRI"};
@@ -6534,25 +10026,30 @@ inline bool Server::parse_request_line(const char *s, Request &req) const {
 
   if (req.version != "HTTP/1.1" && req.version != "HTTP/1.0") { return false; }
 
-  {
-    // Skip URL fragment
-    for (size_t i = 0; i < req.target.size(); i++) {
-      if (req.target[i] == '#') {
-        req.target.erase(i);
-        break;
-      }
+  split_request_target(req);
+  return true;
+}
+
+inline void Server::split_request_target(Request &req) const {
+  // Skip URL fragment
+  for (size_t i = 0; i < req.target.size(); i++) {
+    if (req.target[i] == '#') {
+      req.target.erase(i);
+      break;
     }
+  }
 
-    detail::divide(req.target, '?',
-                   [&](const char *lhs_data, std::size_t lhs_size,
-                       const char *rhs_data, std::size_t rhs_size) {
+  detail::divide(req.target, '?',
+                 [&](const char *lhs_data, std::size_t lhs_size,
+                     const char *rhs_data, std::size_t rhs_size) {
+                   if (memchr(lhs_data, '%', lhs_size)) {
                      req.path = detail::decode_url(
                          std::string(lhs_data, lhs_size), false);
-                     detail::parse_query_text(rhs_data, rhs_size, req.params);
-                   });
-  }
-
-  return true;
+                   } else {
+                     req.path.assign(lhs_data, lhs_size);
+                   }
+                   detail::parse_query_text(rhs_data, rhs_size, req.params);
+                 });
 }
 
 inline bool Server::write_response(Stream &strm, bool close_connection,
@@ -6575,14 +10072,10 @@ inline bool Server::write_response_core(Stream &strm, bool close_connection,
                                         bool need_apply_ranges) {
   assert(res.status != -1);
 
-  if (400 <= res.status && error_handler_ &&
-      error_handler_(req, res) == HandlerResponse::Handled) {
-    need_apply_ranges = true;
-  }
-
   std::string content_type;
   std::string boundary;
-  if (need_apply_ranges) { apply_ranges(req, res, content_type, boundary); }
+  prepare_response(req, res, need_apply_ranges, content_type, boundary);
+  auto has_header_block = !res.header_block_.empty();
 
   // Prepare additional headers
   if (close_connection || req.get_header_value("Connection") == "close") {
@@ -6595,42 +10088,39 @@ inline bool Server::write_response_core(Stream &strm, bool close_connection,
     res.set_header("Keep-Alive", s);
   }
 
-  if ((!res.body.empty() || res.content_length_ > 0 || res.content_provider_) &&
-      !res.has_header("Content-Type")) {
-    res.set_header("Content-Type", "text/plain");
-  }
-
-  if (res.body.empty() && !res.content_length_ && !res.content_provider_ &&
-      !res.has_header("Content-Length")) {
-    res.set_header("Content-Length", "0");
-  }
+  if (post_routing_handler_) { post_routing_handler_(req, res); }
 
-  if (req.method == "HEAD" && !res.has_header("Accept-Ranges")) {
-    res.set_header("Accept-Ranges", "bytes");
+  // Response line and headers, framed in storage the response keeps
+  detail::BufferStream bstrm(std::move(res.head_buffer_));
+  auto keep_buffer = detail::scope_exit(
+      [&] { res.head_buffer_ = bstrm.release_buffer(); });
+  if (!detail::write_response_line(bstrm, res.status)) { return false; }
+  if (has_header_block) {
+    bstrm.write(res.header_block_.data(), res.header_block_.size());
   }
+  if (!header_writer_(bstrm, res.headers)) { return false; }
 
-  if (post_routing_handler_) { post_routing_handler_(req, res); }
-
-  // Response line and headers
-  {
-    detail::BufferStream bstrm;
-    if (!detail::write_response_line(bstrm, res.status)) { return false; }
-    if (!header_writer_(bstrm, res.headers)) { return false; }
+  // The head is held back and sent with the first body write
+  detail::CoalescingStream cstrm(strm, bstrm.get_buffer());
 
-    // Flush buffer
-    auto &data = bstrm.get_buffer();
-    detail::write_data(strm, data.data(), data.size());
-  }
+  // A large provider body goes out in several writes; cork the socket so only
+  // full segments leave until the last piece has been queued.
+  auto corked = req.method != "HEAD" && res.body.empty() &&
+                res.content_provider_ &&
+                (res.content_length_ == 0 ||
+                 res.content_length_ > CPPHTTPLIB_SEND_BUFSIZ) &&
+                detail::set_tcp_cork(strm.socket(), true);
 
   // Body
   auto ret = true;
   if (req.method != "HEAD") {
     if (!res.body.empty()) {
-      if (!detail::write_data(strm, res.body.data(), res.body.size())) {
+      if (!detail::write_data(cstrm, res.body.data(), res.body.size())) {
         ret = false;
       }
     } else if (res.content_provider_) {
-      if (write_content_with_provider(strm, req, res, boundary, content_type)) {
+      if (write_content_with_provider(cstrm, req, res, boundary,
+                                      content_type)) {
         res.content_provider_success_ = true;
       } else {
         ret = false;
@@ -6638,12 +10128,54 @@ inline bool Server::write_response_core(Stream &strm, bool close_connection,
     }
   }
 
+  if (ret && !cstrm.flush()) { ret = false; }
+  if (corked) { detail::set_tcp_cork(strm.socket(), false); }
+
+  // httplib:response__done(fd, method, path, status)
+  CPPHTTPLIB_PROBE4(response__done, strm.socket(), req.method.c_str(),
+                    req.path.c_str(), res.status);
+
   // Log
   if (logger_) { logger_(req, res); }
 
   return ret;
 }
 
+// Everything about the response but its framing: the error page, ranges and
+// the representation headers, as both HTTP/1 and HTTP/2 send them.
+inline void Server::prepare_response(const Request &req, Response &res,
+                                     bool need_apply_ranges,
+                                     std::string &content_type,
+                                     std::string &boundary) {
+  if (400 <= res.status && error_handler_ &&
+      error_handler_(req, res) == HandlerResponse::Handled) {
+    need_apply_ranges = true;
+  }
+
+  if (!res.has_header("Date")) {
+    res.set_header("Date", detail::date_clock().now());
+  }
+
+  // A header block means the handler has already framed the representation
+  if (!res.header_block_.empty()) { return; }
+
+  if (need_apply_ranges) { apply_ranges(req, res, content_type, boundary); }
+
+  if ((!res.body.empty() || res.content_length_ > 0 || res.content_provider_) &&
+      !res.has_header("Content-Type")) {
+    res.set_header("Content-Type", "text/plain");
+  }
+
+  if (res.body.empty() && !res.content_length_ && !res.content_provider_ &&
+      !res.has_header("Content-Length")) {
+    res.set_header("Content-Length", "0");
+  }
+
+  if (req.method == "HEAD" && !res.has_header("Accept-Ranges")) {
+    res.set_header("Accept-Ranges", "bytes");
+  }
+}
+
 inline bool
 Server::write_content_with_provider(Stream &strm, const Request &req,
                                     Response &res, const std::string &boundary,
@@ -6653,7 +10185,7 @@ Server::write_content_with_provider(Stream &strm, const Request &req,
   };
 
   if (res.content_length_ > 0) {
-    if (req.ranges.empty()) {
+    if (req.ranges.empty() || !res.header_block_.empty()) {
       return detail::write_content(strm, res.content_provider_, 0,
                                    res.content_length_, is_shutting_down);
     } else if (req.ranges.size() == 1) {
@@ -6940,13 +10472,20 @@ inline bool Server::listen_internal() {
         break;
       }
 
+      // httplib:accept(fd)
+      CPPHTTPLIB_PROBE1(accept, sock);
+
       detail::set_socket_opt_time(sock, SOL_SOCKET, SO_RCVTIMEO,
                                   read_timeout_sec_, read_timeout_usec_);
       detail::set_socket_opt_time(sock, SOL_SOCKET, SO_SNDTIMEO,
                                   write_timeout_sec_, write_timeout_usec_);
 
-      if (!task_queue->enqueue(
-              [this, sock]() { process_and_close_socket(sock); })) {
+      auto accepted = detail::TickClock::now();
+      if (!task_queue->enqueue([this, sock, accepted]() {
+            detail::connection_queue_ticks() =
+                detail::TickClock::now() - accepted;
+            process_and_close_socket(sock);
+          })) {
         detail::shutdown_socket(sock);
         detail::close_socket(sock);
       }
@@ -7038,16 +10577,10 @@ inline bool Server::routing(Request &req, Response &res, Stream &strm) {
 
 inline bool Server::dispatch_request(Request &req, Response &res,
                                      const Handlers &handlers) const {
-  for (const auto &x : handlers) {
-    const auto &matcher = x.first;
-    const auto &handler = x.second;
-
-    if (matcher->match(req)) {
-      handler(req, res);
-      return true;
-    }
-  }
-  return false;
+  auto handler = handlers.find(req);
+  if (!handler) { return false; }
+  (*handler)(req, res);
+  return true;
 }
 
 inline void Server::apply_ranges(const Request &req, Response &res,
@@ -7158,34 +10691,114 @@ inline void Server::apply_ranges(const Request &req, Response &res,
 inline bool Server::dispatch_request_for_content_reader(
     Request &req, Response &res, ContentReader content_reader,
     const HandlersForContentReader &handlers) const {
-  for (const auto &x : handlers) {
-    const auto &matcher = x.first;
-    const auto &handler = x.second;
+  auto handler = handlers.find(req);
+  if (!handler) { return false; }
+  (*handler)(req, res, content_reader);
+  return true;
+}
 
-    if (matcher->match(req)) {
-      handler(req, res, content_reader);
-      return true;
+inline void Server::RequestArena::reset() {
+  // Bodies can be large; only modest buffers are worth keeping.
+  auto recycle_body = [](std::string &body) {
+    if (body.capacity() > CPPHTTPLIB_RECV_BUFSIZ) {
+      std::string().swap(body);
+    } else {
+      body.clear();
     }
-  }
-  return false;
+  };
+
+  req.method.clear();
+  req.path.clear();
+  req.params.clear();
+  req.headers.clear();
+  recycle_body(req.body);
+  req.remote_addr.clear();
+  req.remote_port = -1;
+  req.local_addr.clear();
+  req.local_port = -1;
+  req.version.clear();
+  req.target.clear();
+  req.files.clear();
+  req.ranges.clear();
+  req.matches = Match();
+  req.path_params.clear();
+  req.is_connection_closed = []() { return true; };
+  req.response_handler = nullptr;
+  req.content_receiver = nullptr;
+  req.progress = nullptr;
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+  req.ssl = nullptr;
+#endif
+  req.redirect_count_ = CPPHTTPLIB_REDIRECT_MAX_COUNT;
+  req.content_length_ = 0;
+  req.content_provider_ = nullptr;
+  req.is_chunked_content_provider_ = false;
+  req.authorization_count_ = 0;
+  req.start_time_ = (std::chrono::steady_clock::time_point::min)();
+  req.queue_ticks_ = 0;
+  req.head_ticks_ = 0;
+
+  // What ~Response would do, then back to a fresh response.
+  if (res.content_provider_resource_releaser_) {
+    res.content_provider_resource_releaser_(res.content_provider_success_);
+  }
+  res.version.clear();
+  res.status = -1;
+  res.reason.clear();
+  res.headers.clear();
+  recycle_body(res.body);
+  res.location.clear();
+  res.content_length_ = 0;
+  res.content_provider_ = nullptr;
+  res.content_provider_resource_releaser_ = nullptr;
+  res.is_chunked_content_provider_ = false;
+  res.content_provider_success_ = false;
+  res.header_block_.clear();
+  res.file_content_path_.clear();
+  res.file_content_content_type_.clear();
 }
 
 inline bool
-Server::process_request(Stream &strm, const std::string &remote_addr,
-                        int remote_port, const std::string &local_addr,
-                        int local_port, bool close_connection,
-                        bool &connection_closed,
+Server::process_request(Stream &strm, RequestArena &arena,
+                        const std::string &remote_addr, int remote_port,
+                        const std::string &local_addr, int local_port,
+                        bool close_connection, bool &connection_closed,
                         const std::function<void(Request &)> &setup_request) {
+  auto recycle = detail::scope_exit([&] { arena.reset(); });
+
+#ifdef CPPHTTPLIB_ALLOW_LF_AS_LINE_TERMINATOR
   std::array<char, 2048> buf{};
 
   detail::stream_line_reader line_reader(strm, buf.data(), buf.size());
 
   // Connection has been closed on client
   if (!line_reader.getline()) { return false; }
+#else
+  auto &head = arena.head;
 
-  Request req;
+  // Connection has been closed on client
+  if (!strm.read_head(head, CPPHTTPLIB_REQUEST_HEAD_MAX_LENGTH)) {
+    return false;
+  }
+  auto head_ticks = detail::TickClock::now();
 
-  Response res;
+  // The HTTP/2 client preface reads as a request line and a blank line.
+  if (h2c_prior_knowledge_ && head == "PRI * HTTP/2.0\r\n\r\n") {
+    connection_closed = true;
+    return process_http2(strm, remote_addr, remote_port, local_addr,
+                         local_port, head.size());
+  }
+#endif
+
+  auto &req = arena.req;
+#ifdef CPPHTTPLIB_ALLOW_LF_AS_LINE_TERMINATOR
+  req.head_ticks_ = detail::TickClock::now();
+#else
+  req.head_ticks_ = head_ticks;
+#endif
+  req.queue_ticks_ = detail::take_connection_queue_ticks();
+
+  auto &res = arena.res;
   res.version = "HTTP/1.1";
   res.headers = default_headers_;
 
@@ -7195,8 +10808,10 @@ Server::process_request(Stream &strm, const std::string &remote_addr,
 #ifndef CPPHTTPLIB_USE_POLL
   // Socket file descriptor exceeded FD_SETSIZE...
   if (strm.socket() >= FD_SETSIZE) {
+#ifdef CPPHTTPLIB_ALLOW_LF_AS_LINE_TERMINATOR
     Headers dummy;
     detail::read_headers(strm, dummy);
+#endif
     res.status = StatusCode::InternalServerError_500;
     return write_response(strm, close_connection, req, res);
   }
@@ -7204,16 +10819,30 @@ Server::process_request(Stream &strm, const std::string &remote_addr,
 #endif
 
   // Request line and headers
+#ifdef CPPHTTPLIB_ALLOW_LF_AS_LINE_TERMINATOR
   if (!parse_request_line(line_reader.ptr(), req) ||
       !detail::read_headers(strm, req.headers)) {
     res.status = StatusCode::BadRequest_400;
     return write_response(strm, close_connection, req, res);
   }
+#else
+  if (!parse_request_head(head, req)) {
+    // The framing is unknown, so the rest of the input cannot be trusted.
+    connection_closed = true;
+    res.status = StatusCode::BadRequest_400;
+    return write_response(strm, true, req, res);
+  }
+#endif
+  // httplib:request__parsed(fd, method, target)
+  CPPHTTPLIB_PROBE3(request__parsed, strm.socket(), req.method.c_str(),
+                    req.target.c_str());
 
   // Check if the request URI doesn't exceed the limit
   if (req.target.size() > CPPHTTPLIB_REQUEST_URI_MAX_LENGTH) {
+#ifdef CPPHTTPLIB_ALLOW_LF_AS_LINE_TERMINATOR
     Headers dummy;
     detail::read_headers(strm, dummy);
+#endif
     res.status = StatusCode::UriTooLong_414;
     return write_response(strm, close_connection, req, res);
   }
@@ -7269,6 +10898,15 @@ Server::process_request(Stream &strm, const std::string &remote_addr,
     return !detail::is_socket_alive(strm.socket());
   };
 
+  if (handle_request(strm, req, res)) {
+    return write_response_with_content(strm, close_connection, req, res);
+  }
+  return write_response(strm, close_connection, req, res);
+}
+
+// Routes the request and settles the response's status and content. False
+// when the response is an error whose content ignores the requested ranges.
+inline bool Server::handle_request(Stream &strm, Request &req, Response &res) {
   // Routing
   auto routed = false;
 #ifdef CPPHTTPLIB_NO_EXCEPTIONS
@@ -7320,7 +10958,7 @@ Server::process_request(Stream &strm, const std::string &remote_addr,
         res.content_length_ = 0;
         res.content_provider_ = nullptr;
         res.status = StatusCode::NotFound_404;
-        return write_response(strm, close_connection, req, res);
+        return false;
       }
 
       auto content_type = res.file_content_content_type_;
@@ -7337,19 +10975,141 @@ Server::process_request(Stream &strm, const std::string &remote_addr,
           });
     }
 
-    if (detail::range_error(req, res)) {
+    if (res.header_block_.empty() && detail::range_error(req, res)) {
       res.body.clear();
       res.content_length_ = 0;
       res.content_provider_ = nullptr;
       res.status = StatusCode::RangeNotSatisfiable_416;
-      return write_response(strm, close_connection, req, res);
+      return false;
     }
 
-    return write_response_with_content(strm, close_connection, req, res);
+    return true;
   } else {
     if (res.status == -1) { res.status = StatusCode::NotFound_404; }
 
-    return write_response(strm, close_connection, req, res);
+    return false;
+  }
+}
+
+inline bool Server::process_http2(Stream &strm, const std::string &remote_addr,
+                                  int remote_port,
+                                  const std::string &local_addr,
+                                  int local_port, size_t preface_read) {
+  http2_connection_count_++;
+
+  detail::http2::SessionHandler handler;
+  handler.respond = [&](Request &req, Response &res, Stream &body,
+                        std::vector<detail::http2::BodyPiece> &pieces) {
+    http2_stream_count_++;
+    CPPHTTPLIB_PROBE3(request__parsed, strm.socket(), req.method.c_str(),
+                      req.target.c_str());
+    req.queue_ticks_ = detail::take_connection_queue_ticks();
+    req.remote_addr = remote_addr;
+    req.remote_port = remote_port;
+    req.set_header("REMOTE_ADDR", req.remote_addr);
+    req.set_header("REMOTE_PORT", std::to_string(req.remote_port));
+
+    req.local_addr = local_addr;
+    req.local_port = local_port;
+    req.set_header("LOCAL_ADDR", req.local_addr);
+    req.set_header("LOCAL_PORT", std::to_string(req.local_port));
+
+    auto sock = strm.socket();
+    req.is_connection_closed = [sock]() {
+      return !detail::is_socket_alive(sock);
+    };
+
+    respond_http2(req, res, body, pieces);
+  };
+  handler.finished = [&](const Request &req, Response &res) {
+    CPPHTTPLIB_PROBE4(response__done, strm.socket(), req.method.c_str(),
+                      req.path.c_str(), res.status);
+    if (logger_) { logger_(req, res); }
+  };
+
+  detail::http2::Session session(strm, std::move(handler), svr_sock_,
+                                 keep_alive_timeout_sec_, payload_max_length_);
+  return session.run(preface_read);
+}
+
+// Settles one HTTP/2 stream's response as process_request() would, and
+// lays its body out in pieces: literal text, and spans of the content
+// provider that the session pulls as flow control allows.
+inline void
+Server::respond_http2(Request &req, Response &res, Stream &body,
+                      std::vector<detail::http2::BodyPiece> &pieces) {
+  res.version = "HTTP/2";
+  res.headers = default_headers_;
+
+  auto need_apply_ranges = false;
+  split_request_target(req);
+  if (req.target.size() > CPPHTTPLIB_REQUEST_URI_MAX_LENGTH) {
+    res.status = StatusCode::UriTooLong_414;
+  } else if (req.has_header("Range") &&
+             !detail::parse_range_header(req.get_header_value("Range"),
+                                         req.ranges)) {
+    res.status = StatusCode::RangeNotSatisfiable_416;
+  } else {
+    need_apply_ranges = handle_request(body, req, res);
+  }
+  // See write_response()
+  if (!need_apply_ranges) { req.ranges.clear(); }
+
+  std::string content_type;
+  std::string boundary;
+  prepare_response(req, res, need_apply_ranges, content_type, boundary);
+  if (post_routing_handler_) { post_routing_handler_(req, res); }
+
+  // DATA frames delimit the body; nothing is compressed on the way.
+  res.headers.erase("Transfer-Encoding");
+  if (res.is_chunked_content_provider_ &&
+      detail::encoding_type(req, res) != detail::EncodingType::None) {
+    res.headers.erase("Content-Encoding");
+  }
+
+  if (req.method == "HEAD" || res.status == StatusCode::NoContent_204 ||
+      res.status == StatusCode::NotModified_304) {
+    return;
+  }
+
+  auto text = [&](std::string s) {
+    detail::http2::BodyPiece piece;
+    piece.text = std::move(s);
+    pieces.push_back(std::move(piece));
+  };
+  auto provided = [&](size_t offset, size_t length) {
+    detail::http2::BodyPiece piece;
+    piece.provided = true;
+    piece.offset = offset;
+    piece.length = length;
+    pieces.push_back(std::move(piece));
+  };
+
+  if (!res.body.empty()) {
+    text(std::move(res.body));
+    res.body.clear();
+  } else if (!res.content_provider_) {
+    return;
+  } else if (res.content_length_ == 0) {
+    provided(0, std::string::npos);
+  } else if (req.ranges.empty() || !res.header_block_.empty()) {
+    provided(0, res.content_length_);
+  } else if (req.ranges.size() == 1) {
+    auto offset_and_length = detail::get_range_offset_and_length(
+        req.ranges[0], res.content_length_);
+    provided(offset_and_length.first, offset_and_length.second);
+  } else {
+    std::string tokens;
+    auto token = [&](const std::string &t) { tokens += t; };
+    detail::process_multipart_ranges_data(
+        req, boundary, content_type, res.content_length_, token, token,
+        [&](size_t offset, size_t length) {
+          text(std::move(tokens));
+          tokens.clear();
+          provided(offset, length);
+          return true;
+        });
+    text(std::move(tokens));
   }
 }
 
@@ -7364,15 +11124,22 @@ inline bool Server::process_and_close_socket(socket_t sock) {
   int local_port = 0;
   detail::get_local_ip_and_port(sock, local_addr, local_port);
 
-  auto ret = detail::process_server_socket(
-      svr_sock_, sock, keep_alive_max_count_, keep_alive_timeout_sec_,
-      read_timeout_sec_, read_timeout_usec_, write_timeout_sec_,
-      write_timeout_usec_,
-      [&](Stream &strm, bool close_connection, bool &connection_closed) {
-        return process_request(strm, remote_addr, remote_port, local_addr,
-                               local_port, close_connection, connection_closed,
-                               nullptr);
-      });
+  bool ret;
+  {
+    // Leaves the wheel before the descriptor can be closed and reused.
+    detail::TimerWheel::Timer timer(*timer_wheel_, sock);
+    RequestArena arena;
+    ret = detail::process_server_socket(
+        svr_sock_, sock, keep_alive_max_count_, keep_alive_timeout_sec_,
+        read_timeout_sec_, read_timeout_usec_, write_timeout_sec_,
+        write_timeout_usec_,
+        [&](Stream &strm, bool close_connection, bool &connection_closed) {
+          return process_request(strm, arena, remote_addr, remote_port,
+                                 local_addr, local_port, close_connection,
+                                 connection_closed, nullptr);
+        },
+        &timer, &min_request_rate_, &min_drain_rate_);
+  }
 
   detail::shutdown_socket(sock);
   detail::close_socket(sock);
@@ -9363,13 +13130,14 @@ inline bool SSLServer::process_and_close_socket(socket_t sock) {
     int local_port = 0;
     detail::get_local_ip_and_port(sock, local_addr, local_port);
 
+    RequestArena arena;
     ret = detail::process_server_socket_ssl(
         svr_sock_, ssl, sock, keep_alive_max_count_, keep_alive_timeout_sec_,
         read_timeout_sec_, read_timeout_usec_, write_timeout_sec_,
         write_timeout_usec_,
         [&](Stream &strm, bool close_connection, bool &connection_closed) {
-          return process_request(strm, remote_addr, remote_port, local_addr,
-                                 local_port, close_connection,
+          return process_request(strm, arena, remote_addr, remote_port,
+                                 local_addr, local_port, close_connection,
                                  connection_closed,
                                  [&](Request &req) { req.ssl = ssl; });
         });
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+constexpr size_t kHugePageSize = 2 << 20;
+
+enum class HugePageKind { HugeTlb, Transparent, None };
+
+// Maps `bytes`, rounded up to whole 2 MB pages, preferring huge pages so a
+// sweep through the memory costs one TLB entry per 2 MB instead of one per
+// 4 KB. Tries MAP_HUGETLB first, which only succeeds where the administrator
+// has reserved pages (vm.nr_hugepages); otherwise maps 2 MB-aligned memory
+// and marks it MADV_HUGEPAGE, which transparent huge pages honour in both
+// the "always" and "madvise" modes. The kernel may still back parts of it
+// with 4 KB pages when it finds no free 2 MB ones; thp_resident_bytes()
+// tells how much it did not. Returns nullptr if the memory cannot be mapped.
+inline void* map_huge_pages(size_t bytes, HugePageKind& kind) {
+    bytes = (bytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+
+#ifdef MAP_HUGETLB
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        kind = HugePageKind::HugeTlb;
+        return p;
+    }
+#endif
+
+    // Over-map by one huge page and trim, so the region starts on a 2 MB
+    // boundary and every 2 MB of it can be a huge page.
+    size_t span = bytes + kHugePageSize;
+    auto* raw = static_cast<char*>(mmap(nullptr, span, PROT_READ | PROT_WRITE,
+                                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (raw == MAP_FAILED) return nullptr;
+    auto addr = reinterpret_cast<uintptr_t>(raw);
+    auto* aligned = reinterpret_cast<char*>((addr + kHugePageSize - 1) & ~(kHugePageSize - 1));
+    size_t head = aligned - raw;
+    if (head > 0) munmap(raw, head);
+    munmap(aligned + bytes, span - head - bytes);
+
+#ifdef MADV_HUGEPAGE
+    kind = madvise(aligned, bytes, MADV_HUGEPAGE) == 0 ? HugePageKind::Transparent
+                                                       : HugePageKind::None;
+#else
+    kind = HugePageKind::None;
+#endif
+    return aligned;
+}
+
+inline void unmap_huge_pages(void* p, size_t bytes) {
+    bytes = (bytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+    munmap(p, bytes);
+}
+
+// Bytes of MADV_HUGEPAGE mappings in this process actually backed by
+// transparent huge pages, from /proc/self/smaps. Mappings nobody else marks
+// that way are ours; with glibc's defaults malloc does not.
+inline size_t thp_resident_bytes() {
+    FILE* f = fopen("/proc/self/smaps", "re");
+    if (!f) return 0;
+    size_t total = 0;
+    size_t anon_huge_kb = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long kb;
+        if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+            anon_huge_kb = kb;
+        } else if (strncmp(line, "VmFlags:", 8) == 0) {
+            // VmFlags ends each mapping's block; "hg" marks MADV_HUGEPAGE.
+            if (strstr(line, " hg")) total += anon_huge_kb * 1024;
+            anon_huge_kb = 0;
+        }
+    }
+    fclose(f);
+    return total;
+}
+
+// Fixed-size blocks carved out of 2 MB huge-page regions and kept for reuse.
+// A region is mapped whenever no block is idle and stays mapped for the life
+// of the pool, so the pool holds as many blocks as were ever in use at once.
+// `block_size` must divide kHugePageSize.
+//
+// A block that may never be reused is retired: its memory is unmapped, which
+// is safe while the kernel still sends from it, as the kernel holds its own
+// references to the pages. Reserved huge pages can only be unmapped whole,
+// so such a region goes once all its blocks are retired; until then it
+// holds at most one region's worth of retired memory.
+class HugePagePool {
+public:
+    explicit HugePagePool(size_t block_size) : block_size_(block_size) {}
+
+    ~HugePagePool() {
+        for (const auto& [start, region] : regions_) unmap_huge_pages(start, kHugePageSize);
+    }
+
+    HugePagePool(const HugePagePool&) = delete;
+    HugePagePool& operator=(const HugePagePool&) = delete;
+
+    // nullptr if no region could be mapped.
+    char* get() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_.empty() && !grow()) return nullptr;
+        char* block = idle_.back();
+        idle_.pop_back();
+        return block;
+    }
+
+    void put(char* block) {
+        if (!block) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.push_back(block);
+    }
+
+    // Takes back a block that can never be reused, because the kernel may
+    // still be sending from it, and unmaps its memory.
+    void retire(char* block) {
+        if (!block) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired_++;
+        auto it = std::prev(regions_.upper_bound(block));
+        auto& region = it->second;
+        region.retired++;
+        if (region.kind != HugePageKind::HugeTlb) {
+            munmap(block, block_size_);
+            unmapped(region.kind, block_size_);
+            reclaimed_++;
+        }
+        if (region.retired == kHugePageSize / block_size_) {
+            if (region.kind == HugePageKind::HugeTlb) {
+                unmap_huge_pages(it->first, kHugePageSize);
+                unmapped(region.kind, kHugePageSize);
+                reclaimed_ += region.retired;
+            }
+            regions_.erase(it);
+        }
+    }
+
+    uint64_t retired() const { return retired_; }
+
+    // Retired blocks whose memory has been unmapped.
+    uint64_t reclaimed() const { return reclaimed_; }
+
+    size_t block_size() const { return block_size_; }
+
+    size_t idle() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return idle_.size();
+    }
+
+    uint64_t blocks() const { return mapped_bytes() / block_size_; }
+
+    uint64_t mapped_bytes() const { return hugetlb_bytes_ + thp_bytes_ + small_bytes_; }
+
+    // Bytes in reserved huge pages, certain to be huge.
+    uint64_t hugetlb_bytes() const { return hugetlb_bytes_; }
+
+    // Bytes marked for transparent huge pages; see thp_resident_bytes() for
+    // how many the kernel has actually backed with them.
+    uint64_t thp_bytes() const { return thp_bytes_; }
+
+    void add_to(std::ostringstream& out) {
+        out << blocks() << " idle=" << idle() << " retired=" << retired_
+            << " reclaimed=" << reclaimed_
+            << " hugetlb_bytes=" << hugetlb_bytes_
+            << " thp_bytes=" << thp_bytes_ << " small_page_bytes=" << small_bytes_;
+    }
+
+private:
+    bool grow() {
+        HugePageKind kind;
+        auto* region = static_cast<char*>(map_huge_pages(kHugePageSize, kind));
+        if (!region) return false;
+        regions_[region] = {kind, 0};
+        for (size_t off = kHugePageSize; off >= block_size_; off -= block_size_) {
+            idle_.push_back(region + off - block_size_);
+        }
+        switch (kind) {
+        case HugePageKind::HugeTlb: hugetlb_bytes_ += kHugePageSize; break;
+        case HugePageKind::Transparent: thp_bytes_ += kHugePageSize; break;
+        case HugePageKind::None: small_bytes_ += kHugePageSize; break;
+        }
+        return true;
+    }
+
+    void unmapped(HugePageKind kind, size_t bytes) {
+        switch (kind) {
+        case HugePageKind::HugeTlb: hugetlb_bytes_ -= bytes; break;
+        case HugePageKind::Transparent: thp_bytes_ -= bytes; break;
+        case HugePageKind::None: small_bytes_ -= bytes; break;
+        }
+    }
+
+    struct Region {
+        HugePageKind kind;
+        size_t retired;
+    };
+
+    const size_t block_size_;
+    std::mutex mutex_;
+    std::vector<char*> idle_;
+    // By start address, so a block finds its region.
+    std::map<char*, Region> regions_;
+    std::atomic<uint64_t> hugetlb_bytes_{0};
+    std::atomic<uint64_t> thp_bytes_{0};
+    std::atomic<uint64_t> small_bytes_{0};
+    std::atomic<uint64_t> retired_{0};
+    std::atomic<uint64_t> reclaimed_{0};
+};
@@ -1,9 +1,21 @@
 #include <httplib.h>
+#include "dir_watcher.h"
+#include "direct_io.h"
+#include "file_cache.h"
+#include "negative_cache.h"
+#include "pacing.h"
+#include "probes.h"
+#include "read_ahead.h"
+#include "send_scheduler.h"
+#include "shard.h"
+#include "tracing.h"
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
 #include <filesystem>
-#include <fstream>
-#include <regex>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 
 namespace fs = std::filesystem;
 using namespace httplib;
@@ -12,6 +24,40 @@ class VideoServer {
 private:
     fs::path base_path_;
     const size_t CHUNK_SIZE = 8192;
+    // One per pool shard, or a single one shared by all threads.
+    std::vector<std::unique_ptr<Shard>> shards_;
+    // Declared after shards_: its thread clears their caches until joined.
+    std::unique_ptr<DirWatcher> watcher_;
+    PacingConfig pacing_;
+    std::unique_ptr<SendScheduler> scheduler_;
+    SessionReadAhead read_ahead_;
+    const size_t direct_min_bytes_;
+    const bool splice_;
+    const size_t zerocopy_min_;
+    RequestTracer tracer_;
+
+    static constexpr size_t kDirectSkipHead = 1 << 20;
+    static constexpr uint64_t kHotRequests = 16;
+    // Below this a splice costs more than the copy it saves: the response
+    // head can no longer share a syscall with the body.
+    static constexpr size_t kSpliceMin = 128 * 1024;
+    static_assert(kChunkBlock >= CPPHTTPLIB_SEND_BUFSIZ_MAX,
+                  "a copied read must fit one chunk buffer");
+
+    Shard& shard() {
+        int i = ShardedThreadPool::current_shard();
+        return *shards_[i >= 0 && static_cast<size_t>(i) < shards_.size() ? i : 0];
+    }
+
+    template <typename F>
+    std::string per_shard(F report) {
+        if (shards_.size() == 1) return report(*shards_[0]);
+        std::string out;
+        for (size_t i = 0; i < shards_.size(); i++) {
+            out += "shard " + std::to_string(i) + "\n" + report(*shards_[i]);
+        }
+        return out;
+    }
 
     void log_request(const Request& req) {
         std::cout << "\n" << std::string(50, '=') << "\n"
@@ -26,28 +72,6 @@ private:
         std::cout << std::string(50, '=') << "\n\n";
     }
 
-    void log_response(int status, const Headers& headers, size_t body_size) {
-        std::cout << "\n" << std::string(50, '=') << "\n"
-                  << "📤 RESPONSE\n"
-                  << std::string(50, '=') << "\n"
-                  << "Status: " << status << "\n\n"
-                  << "Headers:\n";
-        for (const auto& [key, val] : headers) {
-            std::cout << "  " << key << ": " << val << "\n";
-        }
-        std::cout << "Body size: " << body_size << " bytes\n"
-                  << std::string(50, '=') << "\n\n";
-    }
-
-    std::string get_mime_type(const fs::path& path) {
-        std::string ext = path.extension().string();
-        if (ext == ".mp4") return "video/mp4";
-        if (ext == ".webm") return "video/webm";
-        if (ext == ".mkv") return "video/x-matroska";
-        if (ext == ".mov") return "video/quicktime";
-        return "application/octet-stream";
-    }
-
     fs::path translate_path(const std::string& path) {
         std::string clean_path = path;
         if (!clean_path.empty() && clean_path[0] == '/') {
@@ -58,11 +82,318 @@ private:
 
 
 
+    // Streams the file starting at `base`; offsets from httplib are relative.
+    // Each call reads as much as the socket send buffer can take at once, or
+    // as much as the pacer and the send scheduler allow. Where the sink can
+    // take file data directly, reads of kSpliceMin or more through the page
+    // cache are spliced to the socket without passing through user space;
+    // otherwise read buffers come from the shard's pools and go back there
+    // afterwards. With `direct`, bytes past the file's head are read with
+    // O_DIRECT, and sent from the aligned blocks with MSG_ZEROCOPY when the
+    // writes are large enough. Opens, reads and sends are timed into `trace`.
+    ContentProvider make_reader(std::shared_ptr<const FileInfo> info,
+                                size_t base, Shard& shard, bool direct,
+                                std::shared_ptr<RequestTrace> trace,
+                                std::shared_ptr<Pacer> pacer = nullptr,
+                                std::shared_ptr<SendScheduler::Flow> flow = nullptr) {
+        struct State {
+            State(Shard& shard, bool direct, bool splice, size_t zerocopy_min,
+                  std::shared_ptr<RequestTrace> trace)
+                : shard(shard), direct_wanted(direct), splice(splice),
+                  zerocopy_min(zerocopy_min), trace(std::move(trace)) {}
+            ~State() {
+                if (fd >= 0) close(fd);
+                shard.buffers.put(buffer);
+            }
+
+            Shard& shard;
+            int fd = -1;
+            char* buffer = nullptr;
+            bool direct_wanted;
+            bool splice;
+            size_t zerocopy_min;
+            std::unique_ptr<DirectReader> direct;
+            std::shared_ptr<RequestTrace> trace;
+        };
+        auto state = std::make_shared<State>(shard, direct, splice_, zerocopy_min_,
+                                             std::move(trace));
+        return [info, state, base, pacer, flow](size_t offset, size_t length,
+                                                DataSink& sink) {
+            size_t pos = base + offset;
+            auto& trace = *state->trace;
+            if (state->direct_wanted && !state->direct && pos >= kDirectSkipHead) {
+                auto span = trace.span(kOpen);
+                state->direct = std::make_unique<DirectReader>(state->shard.direct_buffers);
+                if (!state->direct->open(info->path)) {
+                    state->direct.reset();
+                    state->direct_wanted = false;
+                    state->shard.io.direct_fallbacks++;
+                }
+            }
+
+            size_t to_read = std::min(sink.preferred_write_size, length);
+            if (flow) to_read = std::min(to_read, flow->quantum());
+            const char* data = nullptr;
+            if (state->direct) {
+                auto span = trace.span(kRead);
+                VIDEO_PROBE3(read__start, info->path.c_str(), pos, to_read);
+                data = state->direct->read(pos, to_read, sink.zerocopy_wait);
+                VIDEO_PROBE3(read__end, info->path.c_str(), pos,
+                             data ? static_cast<ssize_t>(to_read) : -1);
+                if (!data) {
+                    if (!state->direct->refused()) return false;
+                    // The filesystem took the O_DIRECT open but not the
+                    // read; the rest goes through the page cache.
+                    state->direct.reset();
+                    state->direct_wanted = false;
+                    state->shard.io.direct_fallbacks++;
+                }
+            }
+            if (pacer) {
+                to_read = pacer->admit(sink.socket, to_read);
+                if (to_read == 0) return true;
+            }
+            if (flow) {
+                size_t granted = flow->acquire(pos, to_read);
+                if (pacer) pacer->refund(to_read - granted);
+                if (granted == 0) return true;
+                to_read = granted;
+            }
+            if (data) {
+                auto span = trace.span(kSend);
+                if (sink.write_zerocopy && state->zerocopy_min &&
+                    to_read >= state->zerocopy_min) {
+                    if (!sink.write_zerocopy(data, to_read)) return false;
+                    state->direct->pin(sink.zerocopy_issued());
+                    state->shard.io.zerocopy_bytes += to_read;
+                } else if (!sink.write(data, to_read)) {
+                    return false;
+                }
+                state->shard.io.direct_bytes += to_read;
+                // The blocks go back to the pool once the kernel is done with
+                // them; a response that ends early retires them instead.
+                if (to_read == length && state->direct->pinned()) {
+                    if (!sink.zerocopy_wait(sink.zerocopy_issued())) return false;
+                    state->direct->unpin();
+                }
+            } else {
+                if (state->fd < 0) {
+                    auto span = trace.span(kOpen);
+                    state->fd = open(info->path.c_str(), O_RDONLY | O_CLOEXEC);
+                    if (state->fd < 0) return false;
+                }
+                if (sink.write_file && state->splice && to_read >= kSpliceMin) {
+                    auto span = trace.span(kSend);
+                    VIDEO_PROBE3(read__start, info->path.c_str(), pos, to_read);
+                    bool ok = sink.write_file(state->fd, pos, to_read);
+                    VIDEO_PROBE3(read__end, info->path.c_str(), pos,
+                                 ok ? static_cast<ssize_t>(to_read) : -1);
+                    if (!ok) return false;
+                    state->shard.io.spliced_bytes += to_read;
+                } else {
+                    if (!state->buffer && !(state->buffer = state->shard.buffers.get())) {
+                        return false;
+                    }
+                    {
+                        auto span = trace.span(kRead);
+                        VIDEO_PROBE3(read__start, info->path.c_str(), pos, to_read);
+                        ssize_t n = pread(state->fd, state->buffer, to_read, pos);
+                        VIDEO_PROBE3(read__end, info->path.c_str(), pos, n);
+                        if (n != static_cast<ssize_t>(to_read)) return false;
+                    }
+                    auto span = trace.span(kSend);
+                    if (!sink.write(state->buffer, to_read)) return false;
+                    state->shard.io.buffered_bytes += to_read;
+                }
+            }
+            if (pacer) pacer->sent(to_read);
+            return true;
+        };
+    }
+
+    // Cold bulk transfers: long GET bodies of files that no more than
+    // kHotRequests requests, over all shards, have asked for lately, by the
+    // popularity sketches' decaying counts. Reading them through the page
+    // cache would evict the heads of popular files; the first
+    // kDirectSkipHead bytes, which players need to start, stay buffered all
+    // the same.
+    bool read_direct(const Request& req, size_t length) {
+        if (direct_min_bytes_ == 0 || req.method != "GET" || length < direct_min_bytes_) {
+            return false;
+        }
+        uint64_t recent = 0;
+        for (const auto& shard : shards_) recent += shard->popular.file_requests(req.path);
+        return recent <= kHotRequests;
+    }
+
+    // Paces GET bodies of files whose bitrate is known from the MP4 index.
+    // The pacer is kept with the connection and reused while it asks for the
+    // same file; a body of another file replaces it, and one not paced at
+    // all drops it. HTTP/2 streams go unpaced: their bodies are sent by the
+    // session's one thread, which a pacer would put to sleep for them all,
+    // and flow control already lets the client hold back each stream.
+    std::shared_ptr<Pacer> make_pacer(const Request& req,
+                                      const std::shared_ptr<const FileInfo>& info) {
+        if (req.method != "GET" || req.version == "HTTP/2" || pacing_.multiple <= 0) {
+            return nullptr;
+        }
+        // Opens the file and reads its MP4 index, once per cached file.
+        uint64_t rate = info->byte_rate();
+        if (rate * pacing_.multiple < 1) {
+            req.connection_data.reset();
+            return nullptr;
+        }
+        auto pacer = std::static_pointer_cast<Pacer>(req.connection_data);
+        if (!pacer || pacer->path() != req.path) {
+            // The old pacer lifts its kernel rate before the new one sets one.
+            req.connection_data.reset();
+            pacer = std::make_shared<Pacer>(
+                pacing_, rate, shard().pacing,
+                req.remote_addr + ":" + std::to_string(req.remote_port), req.path);
+            req.connection_data = pacer;
+        }
+        pacer->start_response();
+        return pacer;
+    }
+
+    std::shared_ptr<SendScheduler::Flow> open_flow() {
+        return scheduler_ ? scheduler_->open() : nullptr;
+    }
+
+    // Resolves a parsed Range against the file size (RFC 9110 14.1.2).
+    static bool resolve_range(const Range& range, size_t size,
+                              size_t& first, size_t& last) {
+        if (size == 0) return false;
+        if (range.first == -1) {
+            if (range.second <= 0) return false;
+            size_t suffix = static_cast<size_t>(range.second);
+            first = suffix >= size ? 0 : size - suffix;
+            last = size - 1;
+            return true;
+        }
+        if (static_cast<size_t>(range.first) >= size) return false;
+        first = static_cast<size_t>(range.first);
+        last = range.second == -1 || static_cast<size_t>(range.second) >= size
+            ? size - 1 : static_cast<size_t>(range.second);
+        return true;
+    }
+
 public:
-    explicit VideoServer(const std::string& base_path) 
-        : base_path_(fs::absolute(base_path)) {}
+    // `shard_count` matches the pool's shards; 1 when the pool is not sharded.
+    // The send scheduler stays global: egress is one link whichever core
+    // feeds it.
+    VideoServer(const std::string& base_path, const PacingConfig& pacing,
+                uint64_t egress_rate, std::chrono::milliseconds negative_ttl,
+                size_t shard_count, size_t read_ahead_window, size_t direct_min_bytes,
+                bool splice, size_t zerocopy_min, uint64_t trace_sample)
+        : base_path_(fs::absolute(base_path)), pacing_(pacing),
+          read_ahead_(read_ahead_window), direct_min_bytes_(direct_min_bytes),
+          splice_(splice), zerocopy_min_(zerocopy_min), tracer_(trace_sample) {
+        for (size_t i = 0; i < shard_count; i++) {
+            shards_.push_back(std::make_unique<Shard>(negative_ttl, shard_count));
+        }
+        if (shards_[0]->negative.enabled()) {
+            watcher_ = std::make_unique<DirWatcher>(base_path_, [this] {
+                for (auto& shard : shards_) shard->negative.clear();
+            });
+        }
+        if (egress_rate > 0) scheduler_ = std::make_unique<SendScheduler>(egress_rate);
+    }
+
+    std::string pacing_report() {
+        return per_shard([](Shard& shard) { return shard.pacing.report(); });
+    }
+
+    std::string read_ahead_report() {
+        return read_ahead_.enabled() ? read_ahead_.report() : "disabled\n";
+    }
+
+    std::string io_report() {
+        std::ostringstream out;
+        out << "direct_min_bytes " << direct_min_bytes_ << "\n"
+            << "direct_skip_head " << kDirectSkipHead << "\n"
+            << "hot_requests " << kHotRequests << "\n"
+            << "splice " << (splice_ ? "on" : "off") << "\n"
+            << "zerocopy_min " << zerocopy_min_ << "\n";
+        auto& zc = detail::zerocopy_counters();
+        out << "zerocopy_sends " << zc.sends << "\n"
+            << "zerocopy_completions " << zc.completions << "\n"
+            << "zerocopy_copied " << zc.copied << "\n";
+        return out.str() + per_shard([](Shard& shard) {
+            std::ostringstream out;
+            shard.io.add_to(out);
+            out << "chunk_buffers ";
+            shard.buffers.add_to(out);
+            out << "\ndirect_buffers ";
+            shard.direct_buffers.add_to(out);
+            out << "\n";
+            return out.str();
+        }) + huge_page_report();
+    }
+
+    // How much of the buffer pools' memory sits in huge pages: all of what
+    // came from reserved pages, and what the kernel backed transparently.
+    std::string huge_page_report() {
+        uint64_t mapped = 0, hugetlb = 0;
+        for (auto& shard : shards_) {
+            mapped += shard->buffers.mapped_bytes() + shard->direct_buffers.mapped_bytes();
+            hugetlb += shard->buffers.hugetlb_bytes() + shard->direct_buffers.hugetlb_bytes();
+        }
+        uint64_t huge = hugetlb + std::min<uint64_t>(thp_resident_bytes(), mapped - hugetlb);
+        std::ostringstream out;
+        out << "huge_page_mapped_bytes " << mapped << "\n"
+            << "huge_page_backed_bytes " << huge << "\n"
+            << "huge_page_coverage " << (mapped ? double(huge) / mapped : 0.0) << "\n";
+        return out.str();
+    }
+
+    std::string trace_report() { return tracer_.report(shards_); }
+
+    std::string top_report(size_t n) { return Popularity::report(shards_, n); }
+
+    std::string chrome_trace() { return tracer_.chrome_trace(); }
+
+    std::string scheduler_report() {
+        return scheduler_ ? scheduler_->report() : "disabled\n";
+    }
+
+    std::string negative_cache_report() {
+        if (!shards_[0]->negative.enabled()) return "disabled\n";
+        return per_shard([](Shard& shard) { return shard.negative.report(); }) +
+               "inotify " + (watcher_ && watcher_->active() ? "active" : "inactive") + "\n";
+    }
+
+    // `pool` is null when the server runs an unsharded pool.
+    std::string shards_report(const ShardedThreadPool* pool) {
+        std::ostringstream out;
+        for (size_t i = 0; i < shards_.size(); i++) {
+            auto& shard = *shards_[i];
+            out << "shard " << i;
+            if (pool) {
+                out << " cpus=";
+                const auto& cpus = pool->shard_cpus(i);
+                for (size_t c = 0; c < cpus.size(); c++) out << (c ? "," : "") << cpus[c];
+                if (cpus.empty()) out << "any";
+                out << " connections=" << pool->shard_load(i);
+            }
+            out << " requests=" << shard.requests
+                << " not_found=" << shard.not_found
+                << " cached_files=" << shard.files.size()
+                << " idle_buffers=" << shard.buffers.idle() << "\n";
+        }
+        return out.str();
+    }
 
     void operator()(const Request& req, Response& res) {
+        auto& shard = this->shard();
+        auto trace = tracer_.start(req, shard.trace);
+        VIDEO_PROBE4(handler__start, req.method.c_str(), req.path.c_str(),
+                     req.ranges.empty() ? -1 : req.ranges[0].first,
+                     req.ranges.empty() ? -1 : req.ranges[0].second);
+        auto probe_end = detail::scope_exit([&] {
+            VIDEO_PROBE3(handler__end, req.path.c_str(), res.status,
+                         res.content_provider_ ? res.content_length_ : res.body.size());
+        });
         log_request(req);
 
         if (req.method == "OPTIONS") {
@@ -71,102 +402,302 @@ public:
             return;
         }
 
+        shard.requests++;
+
         auto filepath = translate_path(req.path);
         std::cout << "filepath: " << filepath << std::endl;
-            // Check if file exists
-        struct stat st;
-        if (stat(filepath.c_str(), &st) == 0) {
-            // File exists
-            size_t filesize = st.st_size;
-
-            std::ifstream file(filepath, std::ios::binary);
-            if (!file.is_open()) {
-                res.status = 500;
-                res.body = "Error opening file.";
-                return;
+
+        // Known misses skip the stat. The negative cache is only asked about
+        // paths the file cache has no entry for, so none of its false
+        // positives can hide a file being served.
+        std::shared_ptr<const FileInfo> info;
+        bool known_missing = false;
+        {
+            auto span = trace->span(kLookup);
+            info = shard.files.lookup(filepath, [&](const std::string& key) {
+                return known_missing = shard.negative.contains(key);
+            });
+        }
+        if (!info) {
+            if (!known_missing) shard.negative.insert(filepath.native());
+            shard.not_found++;
+            res.status = 404;
+            res.body = "File not found.";
+            return;
+        }
+
+        if (req.ranges.size() > 1) {
+            if (req.method == "GET") {
+                size_t first = 0, last = 0;
+                resolve_range(req.ranges[0], info->size, first, last);
+                shard.popular.record(req.path, first);
             }
+            // Multipart byteranges are rare; let httplib frame them.
+            res.set_header("Accept-Ranges", "bytes");
+            res.set_header("ETag", info->etag);
+            res.set_header("Last-Modified", info->last_modified);
+            res.set_content_provider(
+                info->size, info->content_type,
+                make_reader(info, 0, shard, false, trace, make_pacer(req, info),
+                            open_flow()));
+            return;
+        }
 
-            std::string range_header = req.get_header_value("Range");
-            if (!range_header.empty()) {
-                // Handle Range request
-                std::regex range_regex("bytes=(\\d*)-(\\d*)");
-                std::smatch match;
-                if (std::regex_search(range_header, match, range_regex)) {
-                    long start = std::stol(match[1].str());
-                    long end = match[2].str().empty() ? filesize - 1 : std::stol(match[2].str());
-
-                    if (start > end || start >= filesize) {
-                        res.status = 416;
-                        res.body = "Requested range not satisfiable.";
-                        return;
-                    }
+        size_t first = 0;
+        size_t last = 0;
+        if (!req.ranges.empty() &&
+            !resolve_range(req.ranges[0], info->size, first, last)) {
+            res.status = 416;
+            res.set_header("Accept-Ranges", "bytes");
+            res.set_header("Content-Range", "bytes */" + std::to_string(info->size));
+            return;
+        }
 
-                    long length = end - start + 1;
-                    
-                    res.status = 206;  // Partial Content
-                    res.set_header("Content-Type", "video/mp4");
-                    res.set_header("Content-Length", std::to_string(length));
-                    res.set_header("Content-Range", "bytes " + std::to_string(start) + "-" + std::to_string(end) + "/" + std::to_string(filesize));
-                    res.set_header("Accept-Ranges", "bytes");
-
-                    // Log response
-                    log_response(206, res.headers, length);
-
-                    // Send partial content
-                    file.seekg(start, std::ios::beg);
-                    char buffer[8192];
-                    size_t bytes_sent = 0;
-
-                    while (bytes_sent < length) {
-                        size_t chunk_size = std::min(sizeof(buffer), static_cast<size_t>(length - bytes_sent));
-                        file.read(buffer, chunk_size);
-                        res.body.append(buffer, chunk_size);
-                        bytes_sent += chunk_size;
-                    }
+        if (req.ranges.empty()) last = info->size - 1;
+        if (req.method == "GET") shard.popular.record(req.path, first);
 
-                    return;
-                } else {
-                    res.status = 400;
-                    res.body = "Invalid Range header.";
-                    return;
-                }
-            } else {
-                // Serve the whole file if no Range header
-                res.status = 200;
-                res.set_header("Content-Type", "video/mp4");
-                res.set_header("Content-Length", std::to_string(filesize));
-                res.set_header("Accept-Ranges", "bytes");
-
-                // Log response
-                log_response(200, res.headers, filesize);
-
-                // Send entire content
-                char buffer[8192];
-                while (file.read(buffer, sizeof(buffer))) {
-                    res.body.append(buffer, file.gcount());
-                }
+        if (req.method == "GET" && info->size > 0 && req.has_header("X-Playback-Session-Id")) {
+            bool bounded = !req.ranges.empty() && req.ranges[0].second != -1;
+            read_ahead_.observe(req.get_header_value("X-Playback-Session-Id"),
+                                info->path.native(), info->size, first, last, bounded);
+        }
 
-                return;
-            }
+        bool direct = info->size > 0 && read_direct(req, last - first + 1);
+        if (req.method == "GET") (direct ? shard.io.direct_responses : shard.io.buffered_responses)++;
+
+        // HEAD takes the same path: httplib never invokes the provider for
+        // HEAD, and the file is only opened on the first call.
+        if (req.ranges.empty()) {
+            res.status = 200;
+            res.set_content_provider_with_header_block(
+                info->size, info->headers.full(),
+                make_reader(info, 0, shard, direct, trace, make_pacer(req, info),
+                            open_flow()));
+        } else {
+            res.status = 206;
+            res.set_content_provider_with_header_block(
+                last - first + 1, info->headers.range(first, last),
+                make_reader(info, first, shard, direct, trace, make_pacer(req, info),
+                            open_flow()));
         }
+    }
 
-        res.status = 404;
-        res.body = "File not found.";
-        return;
+    void log_response(int status, const Headers& headers,
+                      const std::string& header_block, size_t body_size) {
+        std::cout << "\n" << std::string(50, '=') << "\n"
+                  << "📤 RESPONSE\n"
+                  << std::string(50, '=') << "\n"
+                  << "Status: " << status << "\n\n"
+                  << "Headers:\n";
+        for (const auto& [key, val] : headers) {
+            std::cout << "  " << key << ": " << val << "\n";
+        }
+        for (size_t pos = 0; pos < header_block.size();) {
+            size_t eol = header_block.find("\r\n", pos);
+            std::cout << "  " << header_block.substr(pos, eol - pos) << "\n";
+            pos = eol + 2;
+        }
+        std::cout << "Body size: " << body_size << " bytes\n"
+                  << std::string(50, '=') << "\n\n";
     }
 };
 
-int main() {
+int main(int argc, char* argv[]) {
+    std::string base_path = "/videos";
+    int port = 8080;
+    PacingConfig pacing;
+    double egress_mbps = 0;
+    size_t min_request_rate = 500;
+    size_t min_drain_rate = 4096;
+    double negative_ttl = 5;
+    size_t shards = 0;
+    size_t shard_threads = 8;
+    double read_ahead_mb = 8;
+    double direct_min_mb = 0;
+    bool splice = true;
+    size_t zerocopy_min_kb = 0;
+    bool h2c = false;
+    uint64_t trace_sample = 0;
+    bool debug = false;
+
+    static const option long_options[] = {
+        {"path", required_argument, nullptr, 'd'},
+        {"port", required_argument, nullptr, 'p'},
+        {"pace-multiple", required_argument, nullptr, 'm'},
+        {"pace-burst", required_argument, nullptr, 'b'},
+        {"egress-mbps", required_argument, nullptr, 'e'},
+        {"min-request-rate", required_argument, nullptr, 'r'},
+        {"min-drain-rate", required_argument, nullptr, 'w'},
+        {"negative-ttl", required_argument, nullptr, 'n'},
+        {"shards", required_argument, nullptr, 's'},
+        {"shard-threads", required_argument, nullptr, 't'},
+        {"read-ahead-mb", required_argument, nullptr, 'a'},
+        {"direct-min-mb", required_argument, nullptr, 'o'},
+        {"no-splice", no_argument, nullptr, 'c'},
+        {"zerocopy-min-kb", required_argument, nullptr, 'z'},
+        {"h2c", no_argument, nullptr, 'h'},
+        {"trace-sample", required_argument, nullptr, 'g'},
+        {"debug", no_argument, nullptr, 'x'},
+        {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'd': base_path = optarg; break;
+        case 'p': port = std::atoi(optarg); break;
+        case 'm': pacing.multiple = std::atof(optarg); break;
+        case 'b': pacing.burst_seconds = std::atof(optarg); break;
+        case 'e': egress_mbps = std::atof(optarg); break;
+        case 'r': min_request_rate = std::strtoul(optarg, nullptr, 10); break;
+        case 'w': min_drain_rate = std::strtoul(optarg, nullptr, 10); break;
+        case 'n': negative_ttl = std::atof(optarg); break;
+        case 's': shards = std::strtoul(optarg, nullptr, 10); break;
+        case 't': shard_threads = std::strtoul(optarg, nullptr, 10); break;
+        case 'a': read_ahead_mb = std::atof(optarg); break;
+        case 'o': direct_min_mb = std::atof(optarg); break;
+        case 'c': splice = false; break;
+        case 'z': zerocopy_min_kb = std::strtoul(optarg, nullptr, 10); break;
+        case 'h': h2c = true; break;
+        case 'g': trace_sample = std::strtoull(optarg, nullptr, 10); break;
+        case 'x': debug = true; break;
+        default:
+            std::cerr << "usage: " << argv[0]
+                      << " [--path DIR] [--port N] [--pace-multiple X]"
+                         " [--pace-burst SECONDS] [--egress-mbps N]"
+                         " [--min-request-rate BYTES/S] [--min-drain-rate BYTES/S]"
+                         " [--negative-ttl SECONDS] [--shards N] [--shard-threads N]"
+                         " [--read-ahead-mb N] [--direct-min-mb N] [--no-splice]"
+                         " [--zerocopy-min-kb N] [--h2c] [--trace-sample N]"
+                         " [--debug]\n";
+            return 1;
+        }
+    }
+
     Server svr;
-    auto handler = std::make_shared<VideoServer>("/videos");
-    
+    // Clients trickling a request or draining a response below these rates
+    // would otherwise pin a pool thread each.
+    svr.set_min_request_rate(min_request_rate);
+    svr.set_min_drain_rate(min_drain_rate);
+    // A player fetching many ranges can multiplex them over one connection
+    // instead of opening one per range in flight.
+    svr.set_h2c_prior_knowledge(h2c);
+    // Shared-nothing mode: a connection stays on one core's shard, and its
+    // requests use that shard's caches, counters and buffers.
+    std::atomic<ShardedThreadPool*> pool{nullptr};
+    if (shards > 0) {
+        svr.new_task_queue = [&pool, shards, shard_threads] {
+            auto p = new ShardedThreadPool(shards, std::max<size_t>(shard_threads, 1));
+            pool = p;
+            return p;
+        };
+    }
+    auto handler = std::make_shared<VideoServer>(
+        base_path, pacing, static_cast<uint64_t>(egress_mbps * 1e6 / 8),
+        std::chrono::milliseconds(static_cast<int64_t>(negative_ttl * 1000)),
+        std::max<size_t>(shards, 1), static_cast<size_t>(read_ahead_mb * (1 << 20)),
+        static_cast<size_t>(direct_min_mb * (1 << 20)), splice, zerocopy_min_kb * 1024,
+        trace_sample);
+
+    // Reports on the server's internals. They name clients and what they
+    // watch, and would shadow videos under debug/, so they are only served
+    // when asked for.
+    if (debug) {
+        svr.Get("/debug/pacing", [handler](const Request&, Response& res) {
+            res.set_content(handler->pacing_report(), "text/plain");
+        });
+        svr.Get("/debug/server", [&svr](const Request&, Response& res) {
+            res.set_content("slow_request_closes " + std::to_string(svr.slow_request_count()) +
+                            "\nslow_drain_closes " + std::to_string(svr.slow_drain_count()) +
+                            "\nhttp2_connections " + std::to_string(svr.http2_connection_count()) +
+                            "\nhttp2_streams " + std::to_string(svr.http2_stream_count()) +
+                            "\n", "text/plain");
+        });
+        svr.Get("/debug/scheduler", [handler](const Request&, Response& res) {
+            res.set_content(handler->scheduler_report(), "text/plain");
+        });
+        svr.Get("/debug/negative-cache", [handler](const Request&, Response& res) {
+            res.set_content(handler->negative_cache_report(), "text/plain");
+        });
+        svr.Get("/debug/io", [handler](const Request&, Response& res) {
+            res.set_content(handler->io_report(), "text/plain");
+        });
+        svr.Get("/debug/read-ahead", [handler](const Request&, Response& res) {
+            res.set_content(handler->read_ahead_report(), "text/plain");
+        });
+        svr.Get("/debug/shards", [handler, &pool](const Request&, Response& res) {
+            res.set_content(handler->shards_report(pool), "text/plain");
+        });
+        // The most requested files and 1 MB segments lately, ?n= of each
+        // (20), at most as many as each shard tracks.
+        svr.Get("/debug/top", [handler](const Request& req, Response& res) {
+            size_t n = 20;
+            if (req.has_param("n")) {
+                n = std::strtoul(req.get_param_value("n").c_str(), nullptr, 10);
+            }
+            res.set_content(handler->top_report(std::min(n, Popularity::kTop)), "text/plain");
+        });
+        svr.Get("/debug/trace", [handler](const Request&, Response& res) {
+            res.set_content(handler->trace_report(), "text/plain");
+        });
+        // Load into chrome://tracing or ui.perfetto.dev.
+        svr.Get("/debug/trace.json", [handler](const Request&, Response& res) {
+            res.set_content(handler->chrome_trace(), "application/json");
+        });
+    }
+    // The landing page index.cpp used to serve, from beside the binary
+    // rather than the working directory. Only "/" is taken, a path no video
+    // can have.
+    std::error_code exe_error;
+    auto exe = fs::read_symlink("/proc/self/exe", exe_error);
+    auto index_page = (exe_error ? fs::current_path() : exe.parent_path()) / "index.html";
+    svr.Get("/", [index_page](const Request&, Response& res) {
+        res.set_file_content(index_page.native(), "text/html");
+    });
+    // A literal prefix followed by ".*" is a prefix route, so this catch-all
+    // costs one tree walk rather than a regex match per request.
     svr.Get(".*", [handler](const Request& req, Response& res) { 
         (*handler)(req, res); 
     });
+    svr.set_logger([handler](const Request& req, const Response& res) {
+        size_t body_size = 0;
+        if (req.method != "HEAD") {
+            body_size = res.has_header("Content-Length")
+                ? res.get_header_value_u64("Content-Length") : res.content_length_;
+        }
+        handler->log_response(res.status, res.headers, res.header_block_, body_size);
+        if (req.method != "HEAD" && res.content_provider_ &&
+            !res.content_provider_success_) {
+            std::cout << "⚠️  Transfer aborted: client went away or the read failed\n";
+        }
+    });
 
-    std::cout << "Serving videos from " << fs::absolute("/videos") << " on port 8080\n";
-    std::cout << "Access videos at http://localhost:8080/\n";
+    std::cout << "Serving videos from " << fs::absolute(base_path) << " on port " << port << "\n";
+    std::cout << "Access videos at http://localhost:" << port << "/\n";
+    if (pacing.multiple > 0) {
+        std::cout << "Pacing MP4 bodies at " << pacing.multiple << "x bitrate after "
+                  << pacing.burst_seconds << "s of playback\n";
+    }
+    if (shards > 0) {
+        std::cout << "Running " << shards << " shards of " << shard_threads
+                  << " threads, each shard pinned to its share of the CPUs\n";
+    }
+    if (direct_min_mb > 0) {
+        std::cout << "Reading cold transfers of " << direct_min_mb
+                  << " MB or more with O_DIRECT\n";
+    }
+    if (egress_mbps > 0) {
+        std::cout << "Scheduling " << egress_mbps << " Mbit/s of egress across clients\n";
+    }
+    if (h2c) {
+        std::cout << "Accepting HTTP/2 with prior knowledge (h2c)\n";
+    }
+    if (trace_sample > 0) {
+        std::cout << "Tracing the stages of 1 in " << trace_sample << " requests\n";
+    }
+    if (debug) {
+        std::cout << "Serving internal reports under /debug/\n";
+    }
 
-    svr.listen("0.0.0.0", 8080);
+    svr.listen("0.0.0.0", port);
     return 0;
 }
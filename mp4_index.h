@@ -0,0 +1,93 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace mp4 {
+
+inline uint32_t read_u32(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+           (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline uint64_t read_u64(const unsigned char* p) {
+    return (uint64_t(read_u32(p)) << 32) | read_u32(p + 4);
+}
+
+// Reads a box header at `offset`. On success `header` and `size` hold the
+// header length and the full box length (to `end` for size 0). Sizes are
+// compared with the room left, never added to `offset`: a 64-bit size from
+// a corrupt file could wrap the sum past `end`.
+inline bool read_box(int fd, uint64_t offset, uint64_t end, char type[4],
+                     uint64_t& header, uint64_t& size) {
+    unsigned char buf[16];
+    if (offset > end || end - offset < 8 || pread(fd, buf, 8, offset) != 8) return false;
+    size = read_u32(buf);
+    header = 8;
+    if (size == 1) {
+        if (end - offset < 16 || pread(fd, buf + 8, 8, offset + 8) != 8) return false;
+        size = read_u64(buf + 8);
+        header = 16;
+    } else if (size == 0) {
+        size = end - offset;
+    }
+    std::copy(buf + 4, buf + 8, type);
+    return size >= header && size <= end - offset;
+}
+
+// Finds the first child box of `type` within [offset, end).
+inline bool find_box(int fd, uint64_t offset, uint64_t end, const char* type,
+                     uint64_t& body, uint64_t& body_end) {
+    while (offset < end) {
+        char box_type[4];
+        uint64_t header = 0, size = 0;
+        if (!read_box(fd, offset, end, box_type, header, size)) return false;
+        if (std::equal(box_type, box_type + 4, type)) {
+            body = offset + header;
+            body_end = offset + size;
+            return true;
+        }
+        offset += size;
+    }
+    return false;
+}
+
+// Average bitrate in bytes per second, from the movie duration in moov/mvhd.
+// Returns 0 when the file is not an MP4 or carries no usable duration. Only a
+// handful of box headers are read, wherever moov sits in the file.
+inline uint64_t byte_rate(const fs::path& path, uint64_t file_size) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+
+    uint64_t rate = 0;
+    uint64_t moov = 0, moov_end = 0, mvhd = 0, mvhd_end = 0;
+    if (find_box(fd, 0, file_size, "moov", moov, moov_end) &&
+        find_box(fd, moov, moov_end, "mvhd", mvhd, mvhd_end)) {
+        unsigned char buf[32];
+        ssize_t n = pread(fd, buf, sizeof(buf), mvhd);
+        uint32_t timescale = 0;
+        uint64_t duration = 0;
+        if (n >= 20 && buf[0] == 0) {
+            timescale = read_u32(buf + 12);
+            duration = read_u32(buf + 16);
+        } else if (n >= 32 && buf[0] == 1) {
+            timescale = read_u32(buf + 20);
+            duration = read_u64(buf + 24);
+        }
+        if (timescale > 0 && duration > 0) {
+            rate = static_cast<uint64_t>(
+                static_cast<double>(file_size) * timescale / duration);
+        }
+    }
+
+    close(fd);
+    return rate;
+}
+
+} // namespace mp4
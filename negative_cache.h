@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Remembers file paths, as requests resolve to them, that named no file, so
+// that repeated misses from scanners and broken clients are answered without
+// a stat. Paths go into a Bloom filter of fixed size: memory stays bounded
+// however many distinct paths are probed, at the price of a small false
+// positive rate.
+//
+// Entries expire after one to two `ttl`s: the filter has two generations,
+// and the older one is dropped each time the newer one is `ttl` old or has
+// taken `max_entries` paths. clear() forgets everything at once, for when a
+// watcher sees files appear.
+class NegativeCache {
+public:
+    // With the defaults and both generations full, about 1 in 100000 paths
+    // never seen before is reported as missing.
+    explicit NegativeCache(std::chrono::milliseconds ttl = std::chrono::seconds(5),
+                           size_t bits = size_t(1) << 22, size_t max_entries = 50000)
+        : ttl_(ttl), max_entries_(max_entries),
+          mask_(round_up_pow2(bits) - 1),
+          current_((mask_ + 1) / 64), previous_((mask_ + 1) / 64),
+          started_(std::chrono::steady_clock::now()) {}
+
+    bool enabled() const { return ttl_.count() > 0; }
+
+    bool contains(const std::string& path) {
+        if (!enabled()) return false;
+        auto h = std::hash<std::string>()(path);
+        std::lock_guard<std::mutex> lock(mutex_);
+        rotate_if_due();
+        bool hit = test(current_, h) || test(previous_, h);
+        (hit ? hits_ : misses_)++;
+        return hit;
+    }
+
+    void insert(const std::string& path) {
+        if (!enabled()) return;
+        auto h = std::hash<std::string>()(path);
+        std::lock_guard<std::mutex> lock(mutex_);
+        rotate_if_due();
+        if (entries_ >= max_entries_) rotate();
+        for (int i = 0; i < kHashes; i++) {
+            size_t bit = probe(h, i);
+            current_[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+        entries_++;
+        inserts_++;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::fill(current_.begin(), current_.end(), 0);
+        std::fill(previous_.begin(), previous_.end(), 0);
+        entries_ = 0;
+        started_ = std::chrono::steady_clock::now();
+        clears_++;
+    }
+
+    std::string report() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ostringstream out;
+        out << "ttl_ms " << ttl_.count() << "\n"
+            << "filter_bits " << mask_ + 1 << "\n"
+            << "generation_entries " << entries_ << "\n"
+            << "hits " << hits_ << "\n"
+            << "misses " << misses_ << "\n"
+            << "inserts " << inserts_ << "\n"
+            << "rotations " << rotations_ << "\n"
+            << "clears " << clears_ << "\n";
+        return out.str();
+    }
+
+private:
+    static constexpr int kHashes = 4;
+
+    static size_t round_up_pow2(size_t n) {
+        size_t p = 64;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    // Double hashing: probe i is h1 + i * h2, with h2 odd.
+    size_t probe(size_t h, int i) const {
+        size_t h2 = ((h >> 32) | (h << 32)) * 0x9e3779b97f4a7c15ull | 1;
+        return (h + i * h2) & mask_;
+    }
+
+    bool test(const std::vector<uint64_t>& bits, size_t h) const {
+        for (int i = 0; i < kHashes; i++) {
+            size_t bit = probe(h, i);
+            if (!(bits[bit / 64] & (uint64_t(1) << (bit % 64)))) return false;
+        }
+        return true;
+    }
+
+    void rotate_if_due() {
+        auto age = std::chrono::steady_clock::now() - started_;
+        if (age < ttl_) return;
+        rotate();
+        // After a quiet spell the generation just retired is stale as well.
+        if (age >= 2 * ttl_) std::fill(previous_.begin(), previous_.end(), 0);
+    }
+
+    void rotate() {
+        previous_.swap(current_);
+        std::fill(current_.begin(), current_.end(), 0);
+        entries_ = 0;
+        started_ = std::chrono::steady_clock::now();
+        rotations_++;
+    }
+
+    const std::chrono::milliseconds ttl_;
+    const size_t max_entries_;
+    const size_t mask_;
+
+    std::mutex mutex_;
+    std::vector<uint64_t> current_;
+    std::vector<uint64_t> previous_;
+    std::chrono::steady_clock::time_point started_;
+    size_t entries_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    uint64_t inserts_ = 0;
+    uint64_t rotations_ = 0;
+    uint64_t clears_ = 0;
+};
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+struct PacingConfig {
+    double multiple = 2.0;       // send rate as a multiple of the bitrate; 0 disables
+    double burst_seconds = 10.0; // playback time sent unpaced at the start of a response
+};
+
+// Live counters for one paced connection. The sending thread updates them
+// while the stats endpoint reads them.
+struct PacingStats {
+    enum Mode { Burst, Kernel, Bucket };
+
+    std::string remote;
+    std::string path;
+    uint64_t target_rate = 0;
+    uint64_t burst_bytes = 0;
+    std::chrono::steady_clock::time_point started;
+    std::atomic<uint64_t> responses{0};
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> throttled_us{0};
+    std::atomic<int> mode{Burst};
+};
+
+class PacingRegistry {
+public:
+    uint64_t add(std::shared_ptr<PacingStats> stats) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t id = ++next_id_;
+        active_[id] = std::move(stats);
+        return id;
+    }
+
+    void remove(uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        active_.erase(id);
+    }
+
+    void count_mode(int mode) {
+        (mode == PacingStats::Kernel ? kernel_total_ : bucket_total_)++;
+    }
+
+    // One line of totals per counter, then one line per paced connection.
+    std::string report() {
+        std::map<uint64_t, std::shared_ptr<PacingStats>> active;
+        uint64_t total = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            active = active_;
+            total = next_id_;
+        }
+
+        static const char* mode_names[] = {"burst", "kernel", "bucket"};
+        auto now = std::chrono::steady_clock::now();
+        std::ostringstream out;
+        out << "connections_total " << total << "\n"
+            << "kernel_paced_total " << kernel_total_ << "\n"
+            << "bucket_paced_total " << bucket_total_ << "\n"
+            << "active " << active.size() << "\n";
+        for (const auto& [id, s] : active) {
+            auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                now - s->started).count();
+            uint64_t sent = s->bytes_sent;
+            out << "conn " << id
+                << " remote=" << s->remote
+                << " path=" << s->path
+                << " responses=" << s->responses
+                << " mode=" << mode_names[s->mode]
+                << " target_Bps=" << s->target_rate
+                << " burst_bytes=" << s->burst_bytes
+                << " sent=" << sent
+                << " elapsed_ms=" << elapsed_ms
+                << " avg_Bps=" << (elapsed_ms > 0 ? sent * 1000 / elapsed_ms : 0)
+                << " throttled_ms=" << s->throttled_us / 1000 << "\n";
+        }
+        return out.str();
+    }
+
+private:
+    std::mutex mutex_;
+    uint64_t next_id_ = 0;
+    std::map<uint64_t, std::shared_ptr<PacingStats>> active_;
+    std::atomic<uint64_t> kernel_total_{0};
+    std::atomic<uint64_t> bucket_total_{0};
+};
+
+// Paces one connection's responses for one file at `multiple` times its
+// bitrate once the first `burst_seconds` of playback have gone out. The
+// burst and the bucket carry over from one response to the next, so a player
+// fetching the file as a run of range requests is paced like one streaming
+// it in a single response. The kernel's SO_MAX_PACING_RATE
+// spaces the packets where available; the token bucket always runs as well,
+// so that no more than about a second of data is queued ahead of schedule and
+// send() never blocks for longer than the write timeout.
+class Pacer {
+public:
+    Pacer(const PacingConfig& config, uint64_t byte_rate, PacingRegistry& registry,
+          std::string remote, std::string path)
+        : registry_(registry), stats_(std::make_shared<PacingStats>()) {
+        stats_->remote = std::move(remote);
+        stats_->path = std::move(path);
+        stats_->target_rate = static_cast<uint64_t>(byte_rate * config.multiple);
+        stats_->burst_bytes = static_cast<uint64_t>(byte_rate * config.burst_seconds);
+        stats_->started = std::chrono::steady_clock::now();
+        id_ = registry_.add(stats_);
+    }
+
+    ~Pacer() {
+#ifdef SO_MAX_PACING_RATE
+        // The connection may carry further, unpaced responses.
+        if (stats_->mode == PacingStats::Kernel) {
+            unsigned int unlimited = ~0U;
+            setsockopt(sock_, SOL_SOCKET, SO_MAX_PACING_RATE, &unlimited,
+                       sizeof(unlimited));
+        }
+#endif
+        registry_.remove(id_);
+    }
+
+    Pacer(const Pacer&) = delete;
+    Pacer& operator=(const Pacer&) = delete;
+
+    const std::string& path() const { return stats_->path; }
+
+    // Called as each response it paces begins.
+    void start_response() { stats_->responses++; }
+
+    // Returns how many of `want` bytes may be written now. Sleeps for at most
+    // 100ms while the bucket refills and returns 0 if it is still short, so
+    // the caller gets back to its liveness checks.
+    size_t admit(int sock, size_t want) {
+        uint64_t sent = stats_->bytes_sent;
+        if (sent < stats_->burst_bytes) {
+            return std::min<uint64_t>(want, stats_->burst_bytes - sent);
+        }
+        if (stats_->mode == PacingStats::Burst) engage(sock);
+
+        want = std::min(want, capacity_);
+        refill();
+        if (tokens_ < want) {
+            auto wait = std::min(std::chrono::duration<double>(
+                                     (want - tokens_) / stats_->target_rate),
+                                 std::chrono::duration<double>(0.1));
+            std::this_thread::sleep_for(wait);
+            stats_->throttled_us += static_cast<uint64_t>(wait.count() * 1e6);
+            refill();
+            if (tokens_ < want) return 0;
+        }
+        tokens_ -= want;
+        return want;
+    }
+
+    // Returns admitted bytes that were not written after all.
+    void refund(size_t n) {
+        if (stats_->mode != PacingStats::Burst) tokens_ += n;
+    }
+
+    void sent(size_t n) { stats_->bytes_sent += n; }
+
+private:
+    void engage(int sock) {
+        sock_ = sock;
+        int mode = PacingStats::Bucket;
+        capacity_ = std::max<size_t>(stats_->target_rate / 4, 16384);
+#ifdef SO_MAX_PACING_RATE
+        unsigned int rate = static_cast<unsigned int>(
+            std::min<uint64_t>(stats_->target_rate, ~0U - 1));
+        if (setsockopt(sock, SOL_SOCKET, SO_MAX_PACING_RATE, &rate,
+                       sizeof(rate)) == 0) {
+            mode = PacingStats::Kernel;
+            capacity_ = std::max<size_t>(stats_->target_rate, 16384);
+        }
+#endif
+        stats_->mode = mode;
+        registry_.count_mode(mode);
+        last_refill_ = std::chrono::steady_clock::now();
+    }
+
+    void refill() {
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> dt = now - last_refill_;
+        last_refill_ = now;
+        tokens_ = std::min(tokens_ + dt.count() * stats_->target_rate,
+                           static_cast<double>(capacity_));
+    }
+
+    PacingRegistry& registry_;
+    std::shared_ptr<PacingStats> stats_;
+    uint64_t id_ = 0;
+    int sock_ = -1;
+    size_t capacity_ = 0;
+    double tokens_ = 0;
+    std::chrono::steady_clock::time_point last_refill_;
+};
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// How often keys have been requested lately, in fixed memory however many
+// distinct keys there are. A count-min sketch: each of kRows rows of
+// counters has one counter per hash of the key, a request increments the
+// key's counter in every row, and the smallest of them is the estimate.
+// Collisions only add, so an estimate is never below the true count, and
+// exceeds it by at most a small fraction of all requests.
+//
+// Counts halve every `half_life`, so a file popular last week and idle now
+// fades out. The first record() after the half-life is up does the halving;
+// there is no thread. Recording takes no lock: counters are atomics, and a
+// record racing the halving lands either before or after it.
+class DecayingSketch {
+public:
+    explicit DecayingSketch(std::chrono::seconds half_life, size_t width = 8192)
+        : half_life_(half_life), mask_(round_up_pow2(width) - 1),
+          counters_(kRows * (mask_ + 1)),
+          next_decay_(now_ns() + half_life_ns()) {}
+
+    DecayingSketch(const DecayingSketch&) = delete;
+    DecayingSketch& operator=(const DecayingSketch&) = delete;
+
+    // Counts one request for the key hashed to `h`; returns its estimate.
+    uint32_t record(size_t h) {
+        decay_if_due();
+        uint32_t estimate = UINT32_MAX;
+        for (int row = 0; row < kRows; row++) {
+            auto& c = counters_[slot(h, row)];
+            estimate = std::min(estimate, c.fetch_add(1, std::memory_order_relaxed) + 1);
+        }
+        return estimate;
+    }
+
+    uint32_t estimate(size_t h) const {
+        uint32_t estimate = UINT32_MAX;
+        for (int row = 0; row < kRows; row++) {
+            estimate = std::min(estimate, counters_[slot(h, row)].load(std::memory_order_relaxed));
+        }
+        return estimate;
+    }
+
+    // Halvings since construction; TopK compares it with its own.
+    uint64_t decays() const { return decays_.load(std::memory_order_acquire); }
+
+    std::chrono::seconds half_life() const { return half_life_; }
+
+private:
+    static constexpr int kRows = 4;
+
+    static size_t round_up_pow2(size_t n) {
+        size_t p = 64;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    int64_t half_life_ns() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(half_life_).count();
+    }
+
+    // Double hashing as in NegativeCache: row i uses h1 + i * h2, h2 odd.
+    size_t slot(size_t h, int row) const {
+        size_t h2 = ((h >> 32) | (h << 32)) * 0x9e3779b97f4a7c15ull | 1;
+        return row * (mask_ + 1) + ((h + row * h2) & mask_);
+    }
+
+    void decay_if_due() {
+        int64_t now = now_ns();
+        int64_t due = next_decay_.load(std::memory_order_relaxed);
+        if (now < due) return;
+        // After a quiet spell several half-lives may have passed at once.
+        int64_t periods = 1 + (now - due) / half_life_ns();
+        if (!next_decay_.compare_exchange_strong(due, due + periods * half_life_ns(),
+                                                 std::memory_order_relaxed)) {
+            return; // Another thread is halving.
+        }
+        int shift = static_cast<int>(std::min<int64_t>(periods, 32));
+        for (auto& c : counters_) {
+            uint32_t v = c.load(std::memory_order_relaxed);
+            uint32_t halved;
+            do {
+                halved = shift >= 32 ? 0 : v >> shift;
+            } while (!c.compare_exchange_weak(v, halved, std::memory_order_relaxed));
+        }
+        decays_.fetch_add(static_cast<uint64_t>(periods), std::memory_order_release);
+    }
+
+    const std::chrono::seconds half_life_;
+    const size_t mask_;
+    std::vector<std::atomic<uint32_t>> counters_;
+    std::atomic<int64_t> next_decay_;
+    std::atomic<uint64_t> decays_{0};
+};
+
+// The `capacity` keys with the highest estimates in a DecayingSketch.
+// Members are kept in a min-heap by estimate; a key is offered after each
+// record, and only one that beats the heap's smallest member and is not
+// already in it takes the lock. That is rare once the heap is full: the
+// hot keys are members already, and cold ones fall below the bar without
+// touching shared state. Members' counts come from the sketch whenever they
+// are read, so they decay with it.
+class TopK {
+public:
+    explicit TopK(size_t capacity) : capacity_(capacity), member_hashes_(capacity) {}
+
+    TopK(const TopK&) = delete;
+    TopK& operator=(const TopK&) = delete;
+
+    // `make_key` gives the key's text, and is only called under the lock.
+    template <typename MakeKey>
+    void offer(const DecayingSketch& sketch, size_t h, uint32_t estimate,
+               const MakeKey& make_key) {
+        if (estimate <= threshold_.load(std::memory_order_relaxed) &&
+            sketch.decays() == decays_seen_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        for (const auto& member : member_hashes_) {
+            if (member.load(std::memory_order_relaxed) == h) return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& e : heap_) {
+            if (e.hash == h) return;
+        }
+        // Members were scored when they joined; rescore them all.
+        for (auto& e : heap_) e.count = sketch.estimate(e.hash);
+        std::make_heap(heap_.begin(), heap_.end(), greater);
+        decays_seen_.store(sketch.decays(), std::memory_order_relaxed);
+
+        if (heap_.size() < capacity_) {
+            size_t slot = heap_.size();
+            heap_.push_back({make_key(), h, estimate, slot});
+            std::push_heap(heap_.begin(), heap_.end(), greater);
+            member_hashes_[slot].store(h, std::memory_order_relaxed);
+        } else if (estimate > heap_.front().count) {
+            std::pop_heap(heap_.begin(), heap_.end(), greater);
+            size_t slot = heap_.back().slot;
+            heap_.back() = {make_key(), h, estimate, slot};
+            std::push_heap(heap_.begin(), heap_.end(), greater);
+            member_hashes_[slot].store(h, std::memory_order_relaxed);
+            evictions_++;
+        }
+        uint32_t bar = heap_.size() < capacity_ ? 0 : heap_.front().count;
+        threshold_.store(bar, std::memory_order_relaxed);
+    }
+
+    // Adds each member's key and hash to `out`.
+    void members(std::map<std::string, size_t>& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& e : heap_) out.emplace(e.key, e.hash);
+    }
+
+    uint64_t evictions() const { return evictions_; }
+
+private:
+    struct Entry {
+        std::string key;
+        size_t hash;
+        uint32_t count;
+        size_t slot; // in member_hashes_
+    };
+
+    static bool greater(const Entry& a, const Entry& b) { return a.count > b.count; }
+
+    const size_t capacity_;
+    // The members' hashes, read without the lock to skip keys already in.
+    std::vector<std::atomic<size_t>> member_hashes_;
+    // The smallest member's estimate when the heap is full; 0 until then.
+    std::atomic<uint32_t> threshold_{0};
+    // The sketch's halvings when the bar was set; a halving lowers it.
+    std::atomic<uint64_t> decays_seen_{0};
+    std::mutex mutex_;
+    std::vector<Entry> heap_;
+    std::atomic<uint64_t> evictions_{0};
+};
+
+// Requests per file, and per 1 MB segment of a file where they start, for
+// one shard. The report merges shards by summing their estimates.
+class Popularity {
+public:
+    static constexpr size_t kSegment = 1 << 20;
+    // Files, and segments, each shard keeps ranked by default.
+    static constexpr size_t kTop = 64;
+
+    explicit Popularity(std::chrono::seconds half_life = std::chrono::seconds(60),
+                        size_t top = kTop)
+        : files_(half_life), ranges_(half_life), top_files_(top), top_ranges_(top) {}
+
+    // A request for `path` whose body starts at byte `first`.
+    void record(const std::string& path, size_t first) {
+        auto h = std::hash<std::string>()(path);
+        top_files_.offer(files_, h, files_.record(h), [&] { return path; });
+
+        size_t segment = first / kSegment;
+        auto range_h = h ^ ((segment + 1) * 0x9e3779b97f4a7c15ull);
+        top_ranges_.offer(ranges_, range_h, ranges_.record(range_h), [&] {
+            return path + " bytes=" + std::to_string(segment * kSegment) + "-" +
+                   std::to_string((segment + 1) * kSegment - 1);
+        });
+    }
+
+    // This shard's decayed count of requests for `path`.
+    uint32_t file_requests(const std::string& path) const {
+        return files_.estimate(std::hash<std::string>()(path));
+    }
+
+    // The `n` hottest files and segments across `shards`, most requested
+    // first, with their decayed request counts.
+    template <typename Shards>
+    static std::string report(const Shards& shards, size_t n) {
+        std::ostringstream out;
+        out << "half_life_s " << shards[0]->popular.files_.half_life().count() << "\n";
+        uint64_t evictions = 0;
+        for (const auto& shard : shards) {
+            evictions += shard->popular.top_files_.evictions() +
+                         shard->popular.top_ranges_.evictions();
+        }
+        out << "top_evictions " << evictions << "\n";
+        add_ranked(out, "file", shards, n, &Popularity::files_, &Popularity::top_files_);
+        add_ranked(out, "range", shards, n, &Popularity::ranges_, &Popularity::top_ranges_);
+        return out.str();
+    }
+
+private:
+    template <typename Shards>
+    static void add_ranked(std::ostringstream& out, const char* label, const Shards& shards,
+                           size_t n, DecayingSketch Popularity::*sketch,
+                           TopK Popularity::*top) {
+        std::map<std::string, size_t> keys;
+        for (const auto& shard : shards) (shard->popular.*top).members(keys);
+        std::vector<std::pair<uint64_t, const std::string*>> ranked;
+        for (const auto& [key, h] : keys) {
+            uint64_t count = 0;
+            for (const auto& shard : shards) count += (shard->popular.*sketch).estimate(h);
+            if (count > 0) ranked.emplace_back(count, &key);
+        }
+        std::sort(ranked.begin(), ranked.end(),
+                  [](const auto& a, const auto& b) { return a.first > b.first; });
+        if (ranked.size() > n) ranked.resize(n);
+        for (const auto& [count, key] : ranked) {
+            out << label << " recent_requests=" << count << " " << *key << "\n";
+        }
+    }
+
+    DecayingSketch files_;
+    DecayingSketch ranges_;
+    TopK top_files_;
+    TopK top_ranges_;
+};
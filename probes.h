@@ -0,0 +1,28 @@
+#pragma once
+
+#include <httplib.h>
+
+// USDT probes of the video_service provider, built on the same sys/sdt.h
+// detection as httplib's own (CPPHTTPLIB_USDT); nothing without it. Until a
+// tracer attaches, a probe is a nop and its arguments sit in registers. To
+// list them: `bpftrace -l 'usdt:./video_service:*'`.
+//
+//   handler__start(method, path, range_first, range_last)
+//       VideoServer was handed a request; the range is its first one, or
+//       -1, -1 without a Range header (-1, N for a suffix range).
+//   handler__end(path, status, body_bytes)
+//       The handler returned. The status is -1 where httplib settles it;
+//       body_bytes is what the response will carry.
+//   read__start(file, offset, length), read__end(file, offset, bytes)
+//       One read of a response body from its file: a pread, an O_DIRECT
+//       block, or a splice, which also sends. bytes is -1 on failure.
+//
+// httplib adds accept(fd), request__parsed(fd, method, target) and
+// response__done(fd, method, path, status).
+#ifdef CPPHTTPLIB_USDT
+#define VIDEO_PROBE3(name, a, b, c) DTRACE_PROBE3(video_service, name, a, b, c)
+#define VIDEO_PROBE4(name, a, b, c, d) DTRACE_PROBE4(video_service, name, a, b, c, d)
+#else
+#define VIDEO_PROBE3(name, a, b, c) ((void)0)
+#define VIDEO_PROBE4(name, a, b, c, d) ((void)0)
+#endif
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Predicts the next range each playback session will ask for and has the
+// kernel start reading it, so that the request finds its pages cached.
+// Players keyed by an X-Playback-Session-Id header (AVFoundation sends one
+// with every request) fetch a file in consecutive bounded ranges of similar
+// size, so the prediction is the window that follows the range just served,
+// as long as that range. Open-ended ranges are left to the kernel's own
+// sequential read-ahead on the streaming descriptor.
+//
+// A session's requests may arrive on several connections, hence on several
+// shards, so the table is shared. One short critical section per range
+// request; the fadvise calls happen on a background thread.
+class SessionReadAhead {
+public:
+    explicit SessionReadAhead(size_t max_window = 8 << 20,
+                              size_t max_sessions = 4096,
+                              std::chrono::seconds idle = std::chrono::seconds(60))
+        : max_window_(max_window), max_sessions_(max_sessions), idle_(idle) {
+        if (enabled()) worker_ = std::thread([this] { run(); });
+    }
+
+    ~SessionReadAhead() {
+        if (!worker_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_one();
+        worker_.join();
+    }
+
+    SessionReadAhead(const SessionReadAhead&) = delete;
+    SessionReadAhead& operator=(const SessionReadAhead&) = delete;
+
+    bool enabled() const { return max_window_ > 0; }
+
+    // Records that `session` is being sent bytes [first, last] of the file at
+    // `path`, `size` bytes long; `bounded` is false for ranges that run to
+    // the end of the file. Scores the previous prediction and queues the
+    // next one.
+    void observe(const std::string& session, const std::string& path, size_t size,
+                 size_t first, size_t last, bool bounded) {
+        if (!enabled() || session.empty() || session.size() > kMaxSessionId) return;
+        auto now = std::chrono::steady_clock::now();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = sessions_.find(session);
+        if (it == sessions_.end()) {
+            if (sessions_.size() >= max_sessions_ && !expire(now)) return;
+            it = sessions_.emplace(session, Session()).first;
+        }
+        auto& s = it->second;
+        s.seen = now;
+
+        if (s.window_len > 0 && s.path == path) {
+            bool hit = first >= s.window_first && first < s.window_first + s.window_len;
+            (hit ? hits_ : misses_)++;
+        }
+
+        s.path = path;
+        s.window_len = 0;
+        if (!bounded) return;
+
+        // A short probe (players read the first bytes to learn the size)
+        // is followed by a read from the same place, not after it.
+        size_t len = last - first + 1;
+        size_t next = len < kMinWindow ? first : last + 1;
+        len = std::min(std::max(len, kMinWindow), max_window_);
+        if (next >= size) return;
+        len = std::min(len, size - next);
+
+        s.window_first = next;
+        s.window_len = len;
+        if (queue_.size() >= kMaxQueued) {
+            dropped_++;
+            return;
+        }
+        queue_.push_back({path, next, len});
+        work_cv_.notify_one();
+    }
+
+    std::string report() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t scored = hits_ + misses_;
+        std::ostringstream out;
+        out << "max_window " << max_window_ << "\n"
+            << "sessions " << sessions_.size() << "\n"
+            << "hits " << hits_ << "\n"
+            << "misses " << misses_ << "\n"
+            << "hit_rate " << (scored ? 100.0 * hits_ / scored : 0.0) << "%\n"
+            << "prefetches " << prefetches_ << "\n"
+            << "prefetched_bytes " << prefetched_bytes_ << "\n"
+            << "dropped " << dropped_ << "\n";
+        return out.str();
+    }
+
+private:
+    static constexpr size_t kMinWindow = 256 * 1024;
+    static constexpr size_t kMaxQueued = 256;
+    static constexpr size_t kMaxSessionId = 128;
+
+    struct Session {
+        std::string path;
+        size_t window_first = 0;
+        size_t window_len = 0; // 0: no prediction outstanding
+        std::chrono::steady_clock::time_point seen;
+    };
+
+    struct Prefetch {
+        std::string path;
+        size_t offset;
+        size_t len;
+    };
+
+    // Drops sessions idle for longer than `idle_`; false if none were.
+    bool expire(std::chrono::steady_clock::time_point now) {
+        size_t before = sessions_.size();
+        for (auto it = sessions_.begin(); it != sessions_.end();) {
+            it = now - it->second.seen > idle_ ? sessions_.erase(it) : std::next(it);
+        }
+        return sessions_.size() < before;
+    }
+
+    void run() {
+        // Setting up the reads costs CPU; a response being sent goes first.
+        sched_param param{};
+        sched_setscheduler(0, SCHED_IDLE, &param);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            work_cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+            if (stop_) return;
+            auto p = std::move(queue_.front());
+            queue_.pop_front();
+            lock.unlock();
+
+            // WILLNEED starts the reads and returns without waiting for them.
+            bool ok = false;
+            int fd = open(p.path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0) {
+                ok = posix_fadvise(fd, p.offset, p.len, POSIX_FADV_WILLNEED) == 0;
+                close(fd);
+            }
+
+            lock.lock();
+            if (ok) {
+                prefetches_++;
+                prefetched_bytes_ += p.len;
+            }
+        }
+    }
+
+    const size_t max_window_;
+    const size_t max_sessions_;
+    const std::chrono::seconds idle_;
+
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::unordered_map<std::string, Session> sessions_;
+    std::deque<Prefetch> queue_;
+    bool stop_ = false;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    uint64_t prefetches_ = 0;
+    uint64_t prefetched_bytes_ = 0;
+    uint64_t dropped_ = 0;
+    std::thread worker_;
+};
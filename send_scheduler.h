@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// Shares a fixed egress rate between streaming responses with deficit round
+// robin. Bytes from the head of a file gate playback startup, so flows sending
+// them are served before bulk flows, except that every fifth grant goes to a
+// waiting bulk flow so a stream of startups cannot stall bulk transfers
+// outright. Each class is round robin.
+//
+// Connection threads ask for a grant before each write; one dispatcher thread
+// hands grants out no faster than the egress rate, so the backlog waits here,
+// ordered, instead of in the kernel's FIFO socket and device queues.
+class SendScheduler {
+public:
+    enum Class { Startup, Bulk };
+
+    class Flow {
+    public:
+        ~Flow() { scheduler_.close(*this); }
+
+        Flow(const Flow&) = delete;
+        Flow& operator=(const Flow&) = delete;
+
+        // Largest grant handed out at once; callers size writes to it.
+        size_t quantum() const { return scheduler_.quantum_; }
+
+        // Asks to send `bytes` starting at `file_offset`. Returns the granted
+        // size, or 0 after 100ms without a grant; the request keeps its place
+        // in the queue until the next call.
+        size_t acquire(size_t file_offset, size_t bytes) {
+            return scheduler_.acquire(*this, file_offset, bytes);
+        }
+
+    private:
+        friend class SendScheduler;
+        explicit Flow(SendScheduler& scheduler) : scheduler_(scheduler) {}
+
+        SendScheduler& scheduler_;
+        std::condition_variable granted_cv_;
+        Class class_ = Bulk;
+        size_t pending_ = 0;
+        size_t granted_ = 0;
+        size_t deficit_ = 0;
+        bool queued_ = false;
+        std::chrono::steady_clock::time_point enqueued_;
+    };
+
+    // `rate` is in bytes per second; flows whose next byte lies below
+    // `startup_bytes` into the file are served first.
+    SendScheduler(uint64_t rate, size_t startup_bytes = 1 << 20,
+                  size_t quantum = 64 * 1024)
+        : rate_(rate), startup_bytes_(startup_bytes), quantum_(quantum),
+          dispatcher_([this] { run(); }) {}
+
+    ~SendScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_one();
+        dispatcher_.join();
+    }
+
+    SendScheduler(const SendScheduler&) = delete;
+    SendScheduler& operator=(const SendScheduler&) = delete;
+
+    std::shared_ptr<Flow> open() { return std::shared_ptr<Flow>(new Flow(*this)); }
+
+    std::string report() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        static const char* class_names[] = {"startup", "bulk"};
+        std::ostringstream out;
+        out << "egress_Bps " << rate_ << "\n"
+            << "quantum " << quantum_ << "\n"
+            << "startup_bytes " << startup_bytes_ << "\n";
+        for (int c = 0; c < 2; c++) {
+            out << class_names[c]
+                << " queued=" << queues_[c].size()
+                << " grants=" << grants_[c]
+                << " bytes=" << bytes_[c]
+                << " avg_wait_us=" << (grants_[c] ? wait_us_[c] / grants_[c] : 0)
+                << "\n";
+        }
+        return out.str();
+    }
+
+private:
+    size_t acquire(Flow& flow, size_t file_offset, size_t bytes) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!flow.queued_ && flow.granted_ == 0) {
+            flow.class_ = file_offset < startup_bytes_ ? Startup : Bulk;
+            flow.pending_ = std::min(bytes, quantum_);
+            flow.queued_ = true;
+            flow.enqueued_ = std::chrono::steady_clock::now();
+            queues_[flow.class_].push_back(&flow);
+            work_cv_.notify_one();
+        } else if (flow.queued_) {
+            flow.pending_ = std::min(bytes, quantum_);
+        }
+
+        flow.granted_cv_.wait_for(lock, std::chrono::milliseconds(100),
+                                  [&] { return flow.granted_ > 0; });
+        size_t granted = std::min(flow.granted_, bytes);
+        flow.granted_ = 0;
+        return granted;
+    }
+
+    void close(Flow& flow) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (flow.queued_) {
+            auto& q = queues_[flow.class_];
+            q.erase(std::find(q.begin(), q.end(), &flow));
+        }
+    }
+
+    // Deficit round robin within the chosen class. A flow has at most one
+    // request queued and requests never exceed the quantum, so one pass
+    // around the queue always finds a flow to serve.
+    Flow* pick() {
+        bool startup = !queues_[Startup].empty() &&
+                       (queues_[Bulk].empty() || startup_streak_ < 4);
+        startup_streak_ = startup ? startup_streak_ + 1 : 0;
+        auto& q = queues_[startup ? Startup : Bulk];
+        for (;;) {
+            Flow* flow = q.front();
+            q.pop_front();
+            if (flow->deficit_ >= flow->pending_) {
+                flow->deficit_ -= flow->pending_;
+                flow->queued_ = false;
+                return flow;
+            }
+            flow->deficit_ += quantum_;
+            q.push_back(flow);
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto next = std::chrono::steady_clock::now();
+        while (!stop_) {
+            if (queues_[Startup].empty() && queues_[Bulk].empty()) {
+                work_cv_.wait(lock);
+                continue;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now < next) {
+                work_cv_.wait_until(lock, next, [&] { return stop_; });
+                continue;
+            }
+
+            Flow* flow = pick();
+            flow->granted_ = flow->pending_;
+            grants_[flow->class_]++;
+            bytes_[flow->class_] += flow->granted_;
+            wait_us_[flow->class_] +=
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    now - flow->enqueued_).count();
+            flow->granted_cv_.notify_one();
+
+            // Idle time does not bank credit for a later burst.
+            next = std::max(next, now) +
+                   std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                       std::chrono::duration<double>(
+                           static_cast<double>(flow->granted_) / rate_));
+        }
+    }
+
+    const uint64_t rate_;
+    const size_t startup_bytes_;
+    const size_t quantum_;
+
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::deque<Flow*> queues_[2];
+    bool stop_ = false;
+    int startup_streak_ = 0;
+    uint64_t grants_[2] = {};
+    uint64_t bytes_[2] = {};
+    uint64_t wait_us_[2] = {};
+    std::thread dispatcher_;
+};
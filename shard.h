@@ -0,0 +1,44 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "direct_io.h"
+#include "file_cache.h"
+#include "negative_cache.h"
+#include "pacing.h"
+#include "popularity.h"
+#include "tracing.h"
+
+// Read buffers for responses copied through user space. A response never
+// reads more at once than the socket send buffer takes, which httplib caps
+// at CPPHTTPLIB_SEND_BUFSIZ_MAX.
+constexpr size_t kChunkBlock = 256 * 1024;
+
+// Everything the requests of one shard touch. Connections stay on the shard
+// that accepted them, so the locks inside are only ever taken from its CPUs
+// and its cache lines never move beyond them. Read buffers sit in huge
+// pages, so streaming through them hardly touches the TLB; they are mapped
+// when a request first needs them, and so first touched by the shard's own
+// threads, on their NUMA node. The rest of a Shard is built and zeroed on
+// the main thread and lies wherever that put it.
+//
+// The negative cache is sized down so that all shards together take what a
+// single one would: each shard sees only its share of the misses.
+struct alignas(64) Shard {
+    Shard(std::chrono::milliseconds negative_ttl, size_t shard_count)
+        : negative(negative_ttl, std::max<size_t>((size_t(1) << 22) / shard_count, 1 << 16),
+                   std::max<size_t>(50000 / shard_count, 1000)) {}
+
+    FileCache files;
+    NegativeCache negative;
+    PacingRegistry pacing;
+    HugePagePool buffers{kChunkBlock};
+    HugePagePool direct_buffers{kDirectBlock};
+    IoStats io;
+    TraceStats trace;
+    Popularity popular;
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> not_found{0};
+};
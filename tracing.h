@@ -0,0 +1,316 @@
+#pragma once
+
+#include <httplib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Where a request's time goes. Queue is the wait of a new connection for a
+// pool thread, counted for its first request only; parse runs from the
+// request head having been read to the handler, through parsing and
+// routing; lookup is the file cache, with its stat; open, read and send are
+// summed over all the body's calls, a splice counting as a send. Total runs
+// from the head to the last byte of a file body, or to the handler's return
+// for responses without one.
+enum TraceStage { kQueue, kParse, kLookup, kOpen, kRead, kSend, kTotal, kStageCount };
+
+inline const char* trace_stage_name(int stage) {
+    static const char* names[] = {"queue", "parse", "lookup", "open", "read", "send", "total"};
+    return names[stage];
+}
+
+// Counts of durations in log-linear buckets, four per power of two, so any
+// value is known to within 12.5% whatever its size. Recording is a few
+// relaxed atomic operations.
+class LatencyHistogram {
+public:
+    void record(uint64_t v) {
+        counts_[bucket(v)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(v, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (v > max && !max_.compare_exchange_weak(max, v, std::memory_order_relaxed)) {
+        }
+    }
+
+    void add_to(LatencyHistogram& total) const {
+        for (int i = 0; i < kBuckets; i++) total.counts_[i] += counts_[i].load();
+        total.count_ += count_.load();
+        total.sum_ += sum_.load();
+        total.max_ = std::max(total.max_.load(), max_.load());
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t mean() const { return count_ ? sum_ / count_ : 0; }
+    uint64_t max() const { return max_; }
+
+    // Middle of the bucket holding the `q` quantile, at most the maximum.
+    uint64_t quantile(double q) const {
+        uint64_t rank = static_cast<uint64_t>(q * count_);
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; i++) {
+            seen += counts_[i];
+            if (seen > rank) {
+                return std::min<uint64_t>(lower(i) + (lower(i + 1) - lower(i)) / 2, max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static constexpr int kBuckets = 256;
+
+    static int bucket(uint64_t v) {
+        if (v < 4) return static_cast<int>(v);
+        int e = 63 - __builtin_clzll(v);
+        return (e - 1) * 4 + static_cast<int>((v >> (e - 2)) & 3);
+    }
+
+    static uint64_t lower(int i) {
+        if (i < 4) return static_cast<uint64_t>(i);
+        if (i >= kBuckets - 4) return UINT64_MAX;
+        return static_cast<uint64_t>(4 + i % 4) << (i / 4 - 1);
+    }
+
+    std::atomic<uint64_t> counts_[kBuckets] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+// One shard's histograms, and its count towards the next sampled request.
+struct TraceStats {
+    LatencyHistogram stages[kStageCount];
+    std::atomic<uint64_t> requests{0};
+};
+
+// The spans of a sampled request, kept for the Chrome trace.
+struct SampledTrace {
+    struct Span {
+        int stage;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    uint64_t id = 0;
+    std::string method;
+    std::string target;
+    std::string range;
+    uint64_t queue_ticks = 0;
+    uint64_t head_ticks = 0;
+    uint64_t end_ticks = 0;
+    std::vector<Span> spans;
+    uint64_t spans_dropped = 0;
+};
+
+class RequestTracer;
+
+// The stage times of one request as it is served. Shared by the handler and
+// the body's reader; whoever drops it last records it. A request is served
+// by one thread at a time, so nothing here is synchronised.
+class RequestTrace {
+public:
+    // Adds the time from its construction to its destruction to a stage.
+    class Span {
+    public:
+        Span(RequestTrace& trace, int stage)
+            : trace_(trace), stage_(stage), start_(httplib::detail::TickClock::now()) {}
+        ~Span() { trace_.add(stage_, start_, httplib::detail::TickClock::now()); }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        RequestTrace& trace_;
+        int stage_;
+        uint64_t start_;
+    };
+
+    RequestTrace(RequestTracer& tracer, TraceStats& stats, const httplib::Request& req,
+                 std::unique_ptr<SampledTrace> sample);
+    ~RequestTrace();
+
+    RequestTrace(const RequestTrace&) = delete;
+    RequestTrace& operator=(const RequestTrace&) = delete;
+
+    Span span(int stage) { return Span(*this, stage); }
+
+    void add(int stage, uint64_t start, uint64_t end) {
+        ticks_[stage] += end - start;
+        seen_ |= 1u << stage;
+        if (!sample_) return;
+        if (sample_->spans.size() < kMaxSpans) {
+            sample_->spans.push_back({stage, start, end});
+        } else {
+            sample_->spans_dropped++;
+        }
+    }
+
+private:
+    // A sampled 200 MB download would otherwise keep thousands.
+    static constexpr size_t kMaxSpans = 1000;
+
+    RequestTracer& tracer_;
+    TraceStats& stats_;
+    uint64_t head_ticks_;
+    uint64_t ticks_[kStageCount] = {};
+    unsigned seen_ = 0;
+    std::unique_ptr<SampledTrace> sample_;
+};
+
+// Per-stage latency histograms for every request, and the spans of one
+// request in `sample_every` (none if 0), of which the latest `keep` are
+// exported as Chrome trace JSON for chrome://tracing or Perfetto.
+class RequestTracer {
+public:
+    explicit RequestTracer(uint64_t sample_every, size_t keep = 256)
+        : sample_every_(sample_every), keep_(keep) {
+        httplib::detail::TickClock::origin();
+    }
+
+    // Starts timing the request the handler was just given, counting its
+    // queue and parse stages.
+    std::shared_ptr<RequestTrace> start(const httplib::Request& req, TraceStats& stats) {
+        std::unique_ptr<SampledTrace> sample;
+        uint64_t n = stats.requests.fetch_add(1, std::memory_order_relaxed);
+        if (sample_every_ && n % sample_every_ == 0) {
+            sample = std::make_unique<SampledTrace>();
+            sample->id = ++sampled_;
+            sample->method = req.method;
+            sample->target = req.target;
+            sample->range = req.get_header_value("Range");
+            sample->queue_ticks = req.queue_ticks_;
+        }
+        auto trace = std::make_shared<RequestTrace>(*this, stats, req, std::move(sample));
+        trace->add(kParse, req.head_ticks_, httplib::detail::TickClock::now());
+        return trace;
+    }
+
+    void keep(std::unique_ptr<SampledTrace> sample) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples_.push_back(std::move(sample));
+        if (samples_.size() > keep_) samples_.pop_front();
+    }
+
+    // One line per stage, over all shards, in microseconds.
+    template <typename Shards>
+    std::string report(const Shards& shards) const {
+        double ns_per_tick = httplib::detail::TickClock::ns_per_tick();
+        std::ostringstream out;
+        out << "clock " << (httplib::detail::TickClock::tsc() ? "tsc" : "steady") << "\n"
+            << "ns_per_tick " << ns_per_tick << "\n"
+            << "sample_every " << sample_every_ << "\n"
+            << "sampled " << sampled_ << "\n";
+        for (int stage = 0; stage < kStageCount; stage++) {
+            LatencyHistogram total;
+            for (const auto& shard : shards) shard->trace.stages[stage].add_to(total);
+            auto us = [&](uint64_t ticks) { return ticks * ns_per_tick / 1000; };
+            char line[256];
+            snprintf(line, sizeof(line),
+                     "%s count=%llu mean_us=%.1f p50_us=%.1f p90_us=%.1f p99_us=%.1f "
+                     "max_us=%.1f\n",
+                     trace_stage_name(stage), static_cast<unsigned long long>(total.count()),
+                     us(total.mean()), us(total.quantile(0.5)), us(total.quantile(0.9)),
+                     us(total.quantile(0.99)), us(total.max()));
+            out << line;
+        }
+        return out.str();
+    }
+
+    // Chrome's trace event format: each sampled request is one track, named
+    // after it, with a span for the request and one per stage call.
+    std::string chrome_trace() const {
+        std::deque<std::shared_ptr<const SampledTrace>> samples;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            samples = samples_;
+        }
+        double ns_per_tick = httplib::detail::TickClock::ns_per_tick();
+        uint64_t origin = httplib::detail::TickClock::origin();
+        auto us = [&](uint64_t ticks) { return ticks * ns_per_tick / 1000; };
+
+        std::ostringstream out;
+        out.precision(3);
+        out << std::fixed << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        const char* sep = "\n";
+        auto event = [&](const char* name, uint64_t id, uint64_t start, uint64_t end) {
+            out << sep << "{\"name\":\"" << name << "\",\"cat\":\"request\",\"ph\":\"X\""
+                << ",\"pid\":1,\"tid\":" << id << ",\"ts\":" << us(start - origin)
+                << ",\"dur\":" << us(end - start);
+            sep = ",\n";
+        };
+        for (const auto& s : samples) {
+            out << sep << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << s->id
+                << ",\"args\":{\"name\":\"" << json_escape(s->method + " " + s->target)
+                << "\"}}";
+            sep = ",\n";
+            event("request", s->id, s->head_ticks, s->end_ticks);
+            out << ",\"args\":{\"range\":\"" << json_escape(s->range)
+                << "\",\"queue_us\":" << us(s->queue_ticks)
+                << ",\"spans_dropped\":" << s->spans_dropped << "}}";
+            for (const auto& span : s->spans) {
+                event(trace_stage_name(span.stage), s->id, span.start, span.end);
+                out << "}";
+            }
+        }
+        out << "\n]}\n";
+        return out.str();
+    }
+
+private:
+    static std::string json_escape(const std::string& s) {
+        std::string out;
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += static_cast<char>(c);
+            } else if (c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+        return out;
+    }
+
+    const uint64_t sample_every_;
+    const size_t keep_;
+    std::atomic<uint64_t> sampled_{0};
+    mutable std::mutex mutex_;
+    std::deque<std::shared_ptr<const SampledTrace>> samples_;
+};
+
+inline RequestTrace::RequestTrace(RequestTracer& tracer, TraceStats& stats,
+                                  const httplib::Request& req,
+                                  std::unique_ptr<SampledTrace> sample)
+    : tracer_(tracer), stats_(stats), head_ticks_(req.head_ticks_), sample_(std::move(sample)) {
+    if (req.queue_ticks_) {
+        ticks_[kQueue] = req.queue_ticks_;
+        seen_ |= 1u << kQueue;
+    }
+}
+
+inline RequestTrace::~RequestTrace() {
+    uint64_t end = httplib::detail::TickClock::now();
+    ticks_[kTotal] = end - head_ticks_;
+    seen_ |= 1u << kTotal;
+    // Histograms hold ticks; the report converts them.
+    for (int stage = 0; stage < kStageCount; stage++) {
+        if (seen_ & (1u << stage)) stats_.stages[stage].record(ticks_[stage]);
+    }
+    if (sample_) {
+        sample_->head_ticks = head_ticks_;
+        sample_->end_ticks = end;
+        tracer_.keep(std::move(sample_));
+    }
+}